@@ -97,6 +97,26 @@ void print_func_name_c(const char *name)
 		   "int nrows, int ncols, int ldim)\n", name);
 }
 
+void print_func_name_c_interior(const char *name)
+{
+	printf("int %s_interior(float* o, int r, int c, int s, const uint8_t* pixels, "
+		   "int ldim)\n", name);
+}
+
+void print_func_name_c_tiled(const char *name)
+{
+	printf("int %s_tiled(float* o, int r, int c, int s, const uint8_t* pixels, "
+		   "int nrows, int ncols, int ntilecols)\n", name);
+}
+
+// the window is inside the image if all binary tests (at most maxr/maxc away from its centre) are
+void print_c_bounds_check(const char *r, const char *c, int maxr, int maxc)
+{
+	printf("	if( (%s+%d*sr)/256>=nrows || (%s-%d*sr)/256<0 || "
+		   "(%s+%d*sc)/256>=ncols || (%s-%d*sc)/256<0 )\n",
+		   r, maxr, r, maxr, c, maxc, c, maxc);
+}
+
 void print_c_code(const char* name, double rotation, bool cuda)
 {
 	static int16_t rtcodes[4096][1024][4];
@@ -127,16 +147,12 @@ void print_c_code(const char* name, double rotation, bool cuda)
 		}
 	}
 
-	if (!cuda)
-	{
-		print_func_name_c(name);
-		printf("{\n");
-	}
-
+	// CPU tables live at file scope, so that the runtime can also reach them
+	// through the CascadeTables descriptor (batched and other evaluators)
 	if (cuda)
 		printf("__device__ short tcodes[%d][%d][4] =\n", ntrees, 1<<tdepth);
 	else
-		printf("	static int16_t tcodes[%d][%d][4] =\n", ntrees, 1<<tdepth);
+		printf("static const int16_t %s_tcodes[%d][%d][4] =\n", name, ntrees, 1<<tdepth);
 
 	printf("	{\n");
 	for (int i = 0; i < ntrees; ++i)
@@ -152,7 +168,7 @@ void print_c_code(const char* name, double rotation, bool cuda)
 	if (cuda)
 		printf("__device__ float lut[%d][%d] =\n", ntrees, 1<<tdepth);
 	else
-		printf("	static float lut[%d][%d] =\n", ntrees, 1<<tdepth);
+		printf("static const float %s_lut[%d][%d] =\n", name, ntrees, 1<<tdepth);
 	printf("	{\n");
 	for (int i = 0; i < ntrees; ++i)
 	{
@@ -167,7 +183,7 @@ void print_c_code(const char* name, double rotation, bool cuda)
 	if (cuda)
 		printf("__device__ float thresholds[%d] =\n", ntrees);
 	else
-		printf("	static float thresholds[%d] =\n", ntrees);
+		printf("static const float %s_thresholds[%d] =\n", name, ntrees);
 	printf("	{\n\t\t");
 	for (int i = 0; i < ntrees - 1; ++i)
 		printf("%ff, ", thresholds[i]);
@@ -176,6 +192,24 @@ void print_c_code(const char* name, double rotation, bool cuda)
 
 	if (cuda)
 		print_func_name_cuda(name);
+	else
+	{
+		printf("static const CascadeTables %s_tables =\n", name);
+		printf("{\n");
+		printf("	%ff, %ff, %d, %d, %d, %d,\n", tsr, tsc, tdepth, ntrees, maxr, maxc);
+		printf("	&%s_tcodes[0][0], &%s_lut[0][0], %s_thresholds,\n", name, name, name);
+		printf("	0\n");
+		printf("};\n\n");
+
+		// the classifier proper has no image-bounds test, find_objects calls it directly
+		// for windows far enough from the image border (see print_c_bounds_check)
+		printf("// same as %s, but the window must be inside the image (no bounds test)\n", name);
+		print_func_name_c_interior(name);
+		printf("{\n");
+		printf("	const int16_t (*tcodes)[%d][4] = %s_tcodes;\n", 1<<tdepth, name);
+		printf("	const float (*lut)[%d] = %s_lut;\n", 1<<tdepth, name);
+		printf("	const float *thresholds = %s_thresholds;\n\n", name);
+	}
 
 	printf("	int sr = (int)(%ff*s);\n", tsr);
 	printf("	int sc = (int)(%ff*s);\n", tsc);
@@ -196,19 +230,15 @@ void print_c_code(const char* name, double rotation, bool cuda)
 	}
 
 	// check image boundaries
-	printf("\n");
-	printf("	if( (r+%d*sr)/256>=nrows || (r-%d*sr)/256<0 || "
-		   "(c+%d*sc)/256>=ncols || (c-%d*sc)/256<0 )\n",
-		   maxr, maxr, maxc, maxc);
 	if (cuda)
 	{
+		printf("\n");
+		print_c_bounds_check("r", "c", maxr, maxc);
 		printf("	{\n");
 		printf("		result[res_stride] = 0;\n");
 		printf("		return;\n");
 		printf("	}\n");
 	}
-	else
-		printf("		return -1;\n");
 
 	printf("\n");
 	if (cuda)
@@ -245,6 +275,55 @@ void print_c_code(const char* name, double rotation, bool cuda)
 		printf("	return 1;\n");
 
 	printf("}\n");
+
+	if (!cuda)
+	{
+		// the usual entry point: bounds test, then the interior classifier
+		printf("\n");
+		print_func_name_c(name);
+		printf("{\n");
+		printf("	int sr = (int)(%ff*s);\n", tsr);
+		printf("	int sc = (int)(%ff*s);\n", tsc);
+		printf("\n");
+		print_c_bounds_check("256*r", "256*c", maxr, maxc);
+		printf("		return -1;\n");
+		printf("\n");
+		printf("	return %s_interior(o, r, c, s, pixels, ldim);\n", name);
+		printf("}\n");
+
+		// the same classifier for images in the layout of TiledImage, with the same signature
+		// (the tiles in a row of the image are passed instead of ldim)
+		printf("\n");
+		printf("// same as %s, for an image in the TiledImage layout with ntilecols tiles in a row\n", name);
+		print_func_name_c_tiled(name);
+		printf("{\n");
+		printf("	const int16_t (*tcodes)[%d][4] = %s_tcodes;\n", 1<<tdepth, name);
+		printf("	const float (*lut)[%d] = %s_lut;\n", 1<<tdepth, name);
+		printf("	const float *thresholds = %s_thresholds;\n\n", name);
+		printf("	int sr = (int)(%ff*s);\n", tsr);
+		printf("	int sc = (int)(%ff*s);\n", tsc);
+		printf("\n");
+		print_c_bounds_check("256*r", "256*c", maxr, maxc);
+		printf("		return -1;\n");
+		printf("\n");
+		printf("	r *= 256;\n");
+		printf("	c *= 256;\n");
+		printf("\n");
+		printf("	*o = 0.0f;\n\n");
+		printf("	for (int i = 0; i < %d; ++i)\n", ntrees);
+		printf("	{\n");
+		printf("		int idx = 1;\n");
+		for (int i = 0; i < tdepth; ++i)
+			printf("		idx = 2*idx + (pixels[get_tiled_index((r+tcodes[i][idx][0]*sr)/256, (c+tcodes[i][idx][1]*sc)/256, ntilecols)]<=pixels[get_tiled_index((r+tcodes[i][idx][2]*sr)/256, (c+tcodes[i][idx][3]*sc)/256, ntilecols)]);\n");
+		printf("\n		*o += lut[i][idx-%d];\n\n", 1<<tdepth);
+		printf("		if (*o <= thresholds[i])\n");
+		printf("			return -1;\n");
+		printf("	}\n");
+		printf("\n	*o -= thresholds[%d];\n", ntrees - 1);
+		printf("\n");
+		printf("	return 1;\n");
+		printf("}\n");
+	}
 }
 
 void usage(const char *prog_name)
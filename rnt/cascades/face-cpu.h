@@ -1,8 +1,4 @@
-int facedet(float* o, int r, int c, int s, const uint8_t* pixels, int nrows, int ncols, int ldim)
-{
-	int i, idx, sr, sc;
-
-	static int16_t tcodes[468][64][4] =
+static const int16_t facedet_tcodes[468][64][4] =
 	{
 		{{0, 0, 0, 0}, {-17, 36, -55, 7}, {124, -28, 22, -51}, {8, -31, -15, -34}, {6, -13, 101, 81}, {20, -50, -19, -53}, {-64, 9, -34, 34}, {9, -42, -58, -85}, {29, 56, -18, -35}, {84, -3, 8, 12}, {-31, 38, 17, -35}, {86, 17, -31, 31}, {118, 38, 11, 60}, {13, 45, -16, 34}, {-68, 1, -30, -39}, {9, 21, -29, -49}, {-39, 98, 16, -45}, {-73, 99, 22, 56}, {31, -40, 73, -16}, {34, 50, -32, 42}, {17, -34, -120, -55}, {-24, -3, 13, -98}, {-68, -3, -52, -96}, {63, -30, -41, -87}, {9, 7, 125, -52}, {-28, 52, 13, 55}, {31, -49, 71, -17}, {34, 13, -126, 48}, {23, 53, -54, 88}, {27, 55, -25, -84}, {30, -50, -31, 37}, {31, -25, -23, 36}, {20, -5, -28, 35}, {108, -89, 25, -63}, {114, -30, -47, -22}, {-3, 97, -73, 10}, {18, 50, -19, -41}, {1, -27, 102, 14}, {24, 59, 75, 18}, {17, 41, -39, 63}, {-38, 42, 36, 53}, {-89, 37, -28, 45}, {6, 63, -20, -36}, {-24, 48, -65, 2}, {10, 67, 75, 69}, {33, 51, -31, -47}, {-28, -33, 32, -37}, {39, -64, -37, -34}, {-44, 11, -34, -33}, {-51, 12, 96, 24}, {-121, 57, 30, -52}, {-44, -1, -19, 45}, {-41, 1, -14, 43}, {10, -45, 107, -61}, {-44, -6, 88, 71}, {23, -60, -22, 40}, {-61, -11, -103, -60}, {-30, 31, 49, 45}, {16, 50, 117, -75}, {11, 51, -24, -102}, {80, -19, -73, -2}, {-12, 40, 23, 53}, {4, -6, -127, 45}, {30, 27, -113, 74}},
 		{{0, 0, 0, 0}, {-67, 9, -32, -29}, {-128, 45, 3, 15}, {35, 45, -19, -20}, {10, 66, -26, 42}, {-23, -20, -69, -11}, {56, 104, -33, 9}, {48, -48, -19, -38}, {6, 0, 60, 20}, {16, 44, -36, 76}, {14, 52, -113, 60}, {-64, -5, 75, 8}, {16, 62, 79, 0}, {101, 22, -52, 94}, {22, 45, -94, 43}, {92, 13, -54, 82}, {-28, -40, 5, 13}, {-61, -7, 78, -1}, {21, -45, 71, 20}, {19, -44, -17, 52}, {-76, 28, -55, 104}, {23, -64, -40, -36}, {-25, 47, 22, -32}, {-20, 3, 118, -67}, {-21, -50, -26, 4}, {29, -42, 69, 25}, {110, 84, 5, 53}, {82, 11, -20, -36}, {-31, -24, 109, 64}, {25, 25, -20, 26}, {22, 42, -107, 54}, {11, 40, -122, 51}, {-19, 58, 32, -46}, {17, 61, -27, 44}, {8, 38, -30, -39}, {25, 62, 54, -10}, {6, -3, -51, -92}, {25, 62, 123, 68}, {9, -12, -26, -24}, {11, -4, -126, -117}, {112, 64, 17, 58}, {23, -44, -21, 26}, {-22, 51, 31, 52}, {-75, -89, 17, 56}, {73, 45, -120, -60}, {-15, 0, -69, -83}, {-47, 11, -28, 24}, {19, -5, 85, -15}, {-119, -125, -1, -42}, {-18, 30, 37, -42}, {124, 62, 10, -5}, {7, 4, 82, 71}, {22, 40, 81, 19}, {35, -52, 52, -95}, {-7, 52, 8, 57}, {104, -5, -68, -85}, {111, 9, -35, 90}, {11, 34, 85, 6}, {8, -7, 86, 21}, {-77, -1, -42, 94}, {26, 54, 52, 56}, {42, -34, -27, -93}, {-88, 0, -18, 25}, {33, 106, -50, -63}},
@@ -474,7 +470,7 @@ int facedet(float* o, int r, int c, int s, const uint8_t* pixels, int nrows, int
 		{{0, 0, 0, 0}, {-35, 48, -46, 47}, {-60, 55, -19, 50}, {-56, 7, 61, 22}, {81, 44, 14, 95}, {-110, 35, -51, 36}, {88, -24, 85, -25}, {-87, 73, 80, 115}, {-46, 57, 28, 49}, {-15, -57, -15, -44}, {-82, -12, -13, 42}, {-7, -23, 8, -44}, {60, -38, -27, 35}, {-34, 43, -18, 55}, {-16, 15, -104, -97}, {-34, 20, -34, 73}, {-68, 35, -8, 39}, {114, 35, -69, 46}, {36, 63, -43, -76}, {16, -28, -36, 56}, {37, 20, -42, 63}, {-84, -65, 63, 78}, {19, 14, -65, 12}, {-121, 47, -103, 29}, {-104, -28, 127, 82}, {106, 11, 66, -119}, {-96, -105, -117, -45}, {83, -24, 88, -31}, {106, 67, 123, 124}, {-79, 7, -114, -5}, {-128, 19, -6, -5}, {79, -13, -79, -27}, {118, -81, 68, -109}, {-101, -8, -51, -111}, {-117, 102, -46, 30}, {-32, -60, -6, -16}, {56, -42, 40, -76}, {3, -38, 104, 31}, {45, 16, 84, 24}, {-9, -98, -108, -95}, {10, -105, -84, -124}, {41, 11, 81, -26}, {112, -10, -71, 71}, {13, -38, 117, -79}, {-95, -101, 23, -30}, {104, -25, 44, 23}, {62, -32, -83, 122}, {32, 66, 8, -106}, {-85, 119, -34, 121}, {-17, -46, 3, 9}, {7, 75, 62, -69}, {-23, 43, -19, -102}, {-20, 2, -69, 105}, {19, 82, -77, 66}, {-95, -47, -22, 36}, {-51, 28, 37, -41}, {-114, -126, 39, -54}, {-97, 87, 33, 58}, {71, 41, 25, -39}, {-22, -115, 61, -76}, {-115, 23, -8, -5}, {-50, 10, 72, 14}, {-120, 112, 62, -46}, {-26, -84, -48, 0}},
 	};
 
-	static float lut[468][64] =
+static const float facedet_lut[468][64] =
 	{
 		{-0.782012f, -0.952649f, -0.733555f, -0.300689f, -0.956667f, -0.990791f, -0.958624f, -0.803761f, -0.915478f, -0.981809f, -0.955603f, -0.988632f, -0.734511f, -0.908597f, -0.943685f, -0.982918f, -0.831591f, -0.518352f, -0.831455f, -0.942828f, 0.378111f, -0.442859f, -0.747355f, -0.187014f, -0.433376f, -0.823282f, -0.768182f, -0.947630f, -0.935730f, -0.745725f, -0.896825f, -0.982419f, 0.691559f, -0.232384f, 0.082416f, -0.684456f, -0.384843f, 0.514712f, 0.929748f, 0.524936f, 0.509272f, -0.415494f, -0.097308f, -0.752277f, -0.482143f, -0.856704f, -0.881543f, -0.969162f, 0.679994f, -0.278233f, -0.804273f, -0.200670f, -0.342971f, -0.836417f, -0.812262f, -0.943285f, -0.726180f, -0.013587f, -0.950186f, -0.723181f, -0.707837f, -0.930989f, -0.944387f, -0.992091f},
 		{-0.816183f, -0.322351f, 0.327252f, -0.602131f, -0.221110f, -0.800754f, -0.747702f, -0.928683f, -0.315368f, -0.732363f, -0.756965f, -0.929079f, -0.741362f, -0.941582f, -0.930930f, -0.981577f, -0.581166f, 0.079379f, -0.479700f, -0.842705f, -0.930873f, -0.685329f, -0.971359f, -0.894311f, 0.272230f, -0.471094f, 0.853666f, 0.332739f, 0.384442f, -0.358257f, -0.232133f, -0.727961f, -0.654165f, -0.873578f, -0.743434f, -0.256611f, -0.876758f, -0.641208f, -0.882933f, -0.964646f, -0.325633f, -0.828387f, 0.417163f, -0.354164f, -0.809066f, -0.512097f, -0.735131f, -0.921468f, -0.309556f, -0.819649f, -0.695039f, -0.894194f, -0.720928f, -0.927568f, -0.911439f, -0.982107f, -0.760045f, -0.924164f, -0.945632f, -0.985340f, -0.916305f, -0.973381f, -0.963733f, -0.993071f},
@@ -946,25 +942,36 @@ int facedet(float* o, int r, int c, int s, const uint8_t* pixels, int nrows, int
 		{-0.026555f, 0.186027f, -0.479810f, 0.056031f, -0.046092f, 0.201434f, 0.158427f, 0.318519f, 0.338270f, 0.094056f, 0.122572f, -0.160255f, -0.199509f, 0.070767f, -0.050405f, 0.260931f, 0.117464f, -0.068163f, -0.366933f, -0.015717f, 0.150323f, 0.583986f, -0.040585f, 0.296788f, -0.704369f, -0.279785f, -0.300529f, 0.025652f, -0.030684f, 0.245840f, -0.041454f, -0.234603f, 0.130833f, -0.010725f, -0.024978f, 0.270870f, -0.141383f, 0.085306f, 0.222506f, -0.000545f, -0.100121f, -0.273782f, 0.039554f, -0.091969f, -0.004253f, 0.117384f, -0.119696f, -0.001454f, -0.276924f, -0.077924f, -0.171327f, 0.155149f, 0.030811f, -0.226520f, -0.446901f, -0.109450f, -0.025268f, 0.462175f, 0.003879f, -0.213234f, 0.379310f, -0.010813f, -0.267957f, 0.070585f},
 	};
 
-	static float thresholds[468] =
+static const float facedet_thresholds[468] =
 	{
 		-0.755066f, -0.995066f, -0.930066f, -0.890607f, -15.000000f, -1.676908f, -15.000000f, -15.000000f, -1.853425f, -15.000000f, -15.000000f, -15.000000f, -2.399022f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -2.784148f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -2.800196f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -2.591585f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -2.655773f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -2.736008f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -2.816243f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -2.848336f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -2.848336f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -2.703914f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -2.703914f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -2.623679f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -2.623679f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -2.447162f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -2.366928f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -2.238552f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -2.110176f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -15.000000f, -1.917613f
 	};
 
-	sr = (int)(1.000000f*s);
-	sc = (int)(1.000000f*s);
+static const CascadeTables facedet_tables =
+{
+	1.000000f, 1.000000f, 6, 468, 128, 128,
+	&facedet_tcodes[0][0], &facedet_lut[0][0], facedet_thresholds,
+	0
+};
+
+// same as facedet, but the window must be inside the image (no bounds test)
+int facedet_interior(float* o, int r, int c, int s, const uint8_t* pixels, int ldim)
+{
+	const int16_t (*tcodes)[64][4] = facedet_tcodes;
+	const float (*lut)[64] = facedet_lut;
+	const float *thresholds = facedet_thresholds;
 
-	r = r*256;
-	c = c*256;
+	int sr = (int)(1.000000f*s);
+	int sc = (int)(1.000000f*s);
 
-	if( (r+128*sr)/256>=nrows || (r-128*sr)/256<0 || (c+128*sc)/256>=ncols || (c-128*sc)/256<0 )
-		return -1;
+	r *= 256;
+	c *= 256;
 
 	*o = 0.0f;
 
-	for(i=0; i<468; ++i)
+	for (int i = 0; i < 468; ++i)
 	{
-		idx = 1;
+		int idx = 1;
 		idx = 2*idx + (pixels[(r+tcodes[i][idx][0]*sr)/256*ldim + (c+tcodes[i][idx][1]*sc)/256]<=pixels[(r+tcodes[i][idx][2]*sr)/256*ldim + (c+tcodes[i][idx][3]*sc)/256]);
 		idx = 2*idx + (pixels[(r+tcodes[i][idx][0]*sr)/256*ldim + (c+tcodes[i][idx][1]*sc)/256]<=pixels[(r+tcodes[i][idx][2]*sr)/256*ldim + (c+tcodes[i][idx][3]*sc)/256]);
 		idx = 2*idx + (pixels[(r+tcodes[i][idx][0]*sr)/256*ldim + (c+tcodes[i][idx][1]*sc)/256]<=pixels[(r+tcodes[i][idx][2]*sr)/256*ldim + (c+tcodes[i][idx][3]*sc)/256]);
@@ -972,13 +979,63 @@ int facedet(float* o, int r, int c, int s, const uint8_t* pixels, int nrows, int
 		idx = 2*idx + (pixels[(r+tcodes[i][idx][0]*sr)/256*ldim + (c+tcodes[i][idx][1]*sc)/256]<=pixels[(r+tcodes[i][idx][2]*sr)/256*ldim + (c+tcodes[i][idx][3]*sc)/256]);
 		idx = 2*idx + (pixels[(r+tcodes[i][idx][0]*sr)/256*ldim + (c+tcodes[i][idx][1]*sc)/256]<=pixels[(r+tcodes[i][idx][2]*sr)/256*ldim + (c+tcodes[i][idx][3]*sc)/256]);
 
-		*o = *o + lut[i][idx-64];
+		*o += lut[i][idx-64];
+
+		if (*o <= thresholds[i])
+			return -1;
+	}
+
+	*o -= thresholds[467];
+
+	return 1;
+}
+
+int facedet(float* o, int r, int c, int s, const uint8_t* pixels, int nrows, int ncols, int ldim)
+{
+	int sr = (int)(1.000000f*s);
+	int sc = (int)(1.000000f*s);
+
+	if( (256*r+128*sr)/256>=nrows || (256*r-128*sr)/256<0 || (256*c+128*sc)/256>=ncols || (256*c-128*sc)/256<0 )
+		return -1;
+
+	return facedet_interior(o, r, c, s, pixels, ldim);
+}
+
+// same as facedet, for an image in the TiledImage layout with ntilecols tiles in a row
+int facedet_tiled(float* o, int r, int c, int s, const uint8_t* pixels, int nrows, int ncols, int ntilecols)
+{
+	const int16_t (*tcodes)[64][4] = facedet_tcodes;
+	const float (*lut)[64] = facedet_lut;
+	const float *thresholds = facedet_thresholds;
+
+	int sr = (int)(1.000000f*s);
+	int sc = (int)(1.000000f*s);
+
+	if( (256*r+128*sr)/256>=nrows || (256*r-128*sr)/256<0 || (256*c+128*sc)/256>=ncols || (256*c-128*sc)/256<0 )
+		return -1;
+
+	r *= 256;
+	c *= 256;
+
+	*o = 0.0f;
+
+	for (int i = 0; i < 468; ++i)
+	{
+		int idx = 1;
+		idx = 2*idx + (pixels[get_tiled_index((r+tcodes[i][idx][0]*sr)/256, (c+tcodes[i][idx][1]*sc)/256, ntilecols)]<=pixels[get_tiled_index((r+tcodes[i][idx][2]*sr)/256, (c+tcodes[i][idx][3]*sc)/256, ntilecols)]);
+		idx = 2*idx + (pixels[get_tiled_index((r+tcodes[i][idx][0]*sr)/256, (c+tcodes[i][idx][1]*sc)/256, ntilecols)]<=pixels[get_tiled_index((r+tcodes[i][idx][2]*sr)/256, (c+tcodes[i][idx][3]*sc)/256, ntilecols)]);
+		idx = 2*idx + (pixels[get_tiled_index((r+tcodes[i][idx][0]*sr)/256, (c+tcodes[i][idx][1]*sc)/256, ntilecols)]<=pixels[get_tiled_index((r+tcodes[i][idx][2]*sr)/256, (c+tcodes[i][idx][3]*sc)/256, ntilecols)]);
+		idx = 2*idx + (pixels[get_tiled_index((r+tcodes[i][idx][0]*sr)/256, (c+tcodes[i][idx][1]*sc)/256, ntilecols)]<=pixels[get_tiled_index((r+tcodes[i][idx][2]*sr)/256, (c+tcodes[i][idx][3]*sc)/256, ntilecols)]);
+		idx = 2*idx + (pixels[get_tiled_index((r+tcodes[i][idx][0]*sr)/256, (c+tcodes[i][idx][1]*sc)/256, ntilecols)]<=pixels[get_tiled_index((r+tcodes[i][idx][2]*sr)/256, (c+tcodes[i][idx][3]*sc)/256, ntilecols)]);
+		idx = 2*idx + (pixels[get_tiled_index((r+tcodes[i][idx][0]*sr)/256, (c+tcodes[i][idx][1]*sc)/256, ntilecols)]<=pixels[get_tiled_index((r+tcodes[i][idx][2]*sr)/256, (c+tcodes[i][idx][3]*sc)/256, ntilecols)]);
+
+		*o += lut[i][idx-64];
 
-		if(*o<=thresholds[i])
+		if (*o <= thresholds[i])
 			return -1;
 	}
 
-	*o = *o - thresholds[467];
+	*o -= thresholds[467];
 
 	return 1;
 }
@@ -0,0 +1,326 @@
+#include "picornt.h"
+
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__unix__) || defined(__APPLE__))
+#define HAVE_X86_64_JIT
+#include <sys/mman.h>
+#endif
+
+/*
+	The compiled function has the signature
+
+		int f(float *o, const uint8_t *p, const int32_t *offsets)
+
+	(System V calling convention: rdi = o, rsi = p, rdx = offsets) and does the same
+	as classify_window with ScanPlan offsets, with all loops unrolled:
+
+		xorps xmm0, xmm0
+		lea rcx, [rip + luts]
+		; for every tree i
+		mov eax, 1
+		; for every level
+		movsxd r8, [rdx + rax*8 + 8*i*nnodes]
+		movsxd r9, [rdx + rax*8 + 8*i*nnodes + 4]
+		movzx r8d, byte [rsi + r8]
+		movzx r9d, byte [rsi + r9]
+		cmp r9d, r8d
+		cmc
+		adc eax, eax  ; idx = 2*idx + (p[off1] <= p[off2])
+		; end of level
+		addss xmm0, [rcx + rax*4 + 4*(i-1)*nnodes]
+		mov r10d, <threshold>
+		movd xmm1, r10d
+		ucomiss xmm1, xmm0
+		jae reject
+		; end of tree
+		...
+
+	The lookup tables are stored right after the code, in the same mapping.
+*/
+
+#ifdef HAVE_X86_64_JIT
+
+struct Emitter
+{
+	std::vector<uint8_t> code;
+	std::vector<size_t> rejects;  // positions of the rel32 fields of the jumps to the reject label
+
+	void bytes(const uint8_t *b, int n)
+	{
+		code.insert(code.end(), b, b + n);
+	}
+
+	void u32(uint32_t x)
+	{
+		for (int k = 0; k < 4; ++k)
+			code.push_back((uint8_t)(x >> 8*k));
+	}
+
+	void f32(float x)
+	{
+		uint32_t u;
+		memcpy(&u, &x, sizeof(u));
+		u32(u);
+	}
+
+	void patch32(size_t pos, uint32_t x)
+	{
+		for (int k = 0; k < 4; ++k)
+			code[pos + k] = (uint8_t)(x >> 8*k);
+	}
+
+	// mov r10d, <x>; movd xmm1, r10d
+	void load_xmm1(float x)
+	{
+		static const uint8_t mov_r10d[] = {0x41, 0xBA};
+		static const uint8_t movd_xmm1_r10d[] = {0x66, 0x41, 0x0F, 0x6E, 0xCA};
+
+		bytes(mov_r10d, sizeof(mov_r10d));
+		f32(x);
+		bytes(movd_xmm1_r10d, sizeof(movd_xmm1_r10d));
+	}
+};
+
+static void emit_cascade(Emitter &e, const CascadeTables &cascade, size_t *lea_disp)
+{
+	static const uint8_t prologue[] = {
+		0x0F, 0x57, 0xC0,  // xorps xmm0, xmm0
+		0x48, 0x8D, 0x0D  // lea rcx, [rip + disp32]
+	};
+	static const uint8_t mov_eax_1[] = {0xB8, 0x01, 0x00, 0x00, 0x00};
+	static const uint8_t movsxd_r8[] = {0x4C, 0x63, 0x84, 0xC2};  // movsxd r8, [rdx + rax*8 + disp32]
+	static const uint8_t movsxd_r9[] = {0x4C, 0x63, 0x8C, 0xC2};  // movsxd r9, [rdx + rax*8 + disp32]
+	static const uint8_t compare[] = {
+		0x46, 0x0F, 0xB6, 0x04, 0x06,  // movzx r8d, byte [rsi + r8]
+		0x46, 0x0F, 0xB6, 0x0C, 0x0E,  // movzx r9d, byte [rsi + r9]
+		0x45, 0x39, 0xC1,  // cmp r9d, r8d
+		0xF5,  // cmc
+		0x11, 0xC0  // adc eax, eax
+	};
+	static const uint8_t addss_lut[] = {0xF3, 0x0F, 0x58, 0x84, 0x81};  // addss xmm0, [rcx + rax*4 + disp32]
+	static const uint8_t ucomiss_jae[] = {
+		0x0F, 0x2E, 0xC8,  // ucomiss xmm1, xmm0
+		0x0F, 0x83  // jae rel32
+	};
+	static const uint8_t accept[] = {
+		0xF3, 0x0F, 0x5C, 0xC1,  // subss xmm0, xmm1
+		0xF3, 0x0F, 0x11, 0x07,  // movss [rdi], xmm0
+		0xB8, 0x01, 0x00, 0x00, 0x00,  // mov eax, 1
+		0xC3  // ret
+	};
+	static const uint8_t reject[] = {
+		0xF3, 0x0F, 0x11, 0x07,  // movss [rdi], xmm0
+		0xB8, 0xFF, 0xFF, 0xFF, 0xFF,  // mov eax, -1
+		0xC3  // ret
+	};
+
+	const int nnodes = 1<<cascade.tdepth;
+
+	e.bytes(prologue, sizeof(prologue));
+	*lea_disp = e.code.size();
+	e.u32(0);
+
+	for (int i = 0; i < cascade.ntrees; ++i)
+	{
+		e.bytes(mov_eax_1, sizeof(mov_eax_1));
+		for (int j = 0; j < cascade.tdepth; ++j)
+		{
+			e.bytes(movsxd_r8, sizeof(movsxd_r8));
+			e.u32(8*i*nnodes);
+			e.bytes(movsxd_r9, sizeof(movsxd_r9));
+			e.u32(8*i*nnodes + 4);
+			e.bytes(compare, sizeof(compare));
+		}
+
+		e.bytes(addss_lut, sizeof(addss_lut));
+		e.u32((uint32_t)(4*(i-1)*nnodes));
+
+		e.load_xmm1(cascade.thresholds[i]);
+		e.bytes(ucomiss_jae, sizeof(ucomiss_jae));
+		e.rejects.push_back(e.code.size());
+		e.u32(0);
+	}
+
+	e.load_xmm1(cascade.thresholds[cascade.ntrees-1]);
+	e.bytes(accept, sizeof(accept));
+
+	for (size_t k = 0; k < e.rejects.size(); ++k)
+		e.patch32(e.rejects[k], (uint32_t)(e.code.size() - (e.rejects[k] + 4)));
+	e.bytes(reject, sizeof(reject));
+}
+
+typedef int (*jit_func)(float*, const uint8_t*, const int32_t*);
+
+// writes the code and the lookup tables into an executable mapping
+static void *map_cascade(const CascadeTables &cascade, size_t *size)
+{
+	Emitter e;
+	size_t lea_disp;
+	emit_cascade(e, cascade, &lea_disp);
+
+	// the lookup tables go after the code, 16-byte aligned
+	while (e.code.size() % 16)
+		e.code.push_back(0xCC);
+	e.patch32(lea_disp, (uint32_t)(e.code.size() - (lea_disp + 4)));
+
+	const size_t nluts = (size_t)cascade.ntrees << cascade.tdepth;
+	const size_t nbytes = e.code.size() + nluts*sizeof(float);
+
+	// the displacements are 32-bit
+	if (nbytes > 0x7FFFFFFF)
+		return 0;
+
+	void *mem = mmap(0, nbytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED)
+		return 0;
+
+	memcpy(mem, &e.code[0], e.code.size());
+	memcpy((uint8_t*)mem + e.code.size(), cascade.luts, nluts*sizeof(float));
+
+	if (mprotect(mem, nbytes, PROT_READ | PROT_EXEC) != 0)
+	{
+		munmap(mem, nbytes);
+		return 0;
+	}
+
+	*size = nbytes;
+	return mem;
+}
+
+// compares the compiled code with classify_window on random windows of a noise image,
+// inside the area where find_objects uses the offsets
+static bool check_cascade(jit_func func, const CascadeTables &cascade)
+{
+	const int nrows = 192;
+	const int ncols = 192;
+
+	uint32_t seed = 0x9E3779B9;
+	std::vector<uint8_t> pixels(nrows*ncols);
+	for (size_t k = 0; k < pixels.size(); ++k)
+	{
+		seed = 1664525*seed + 1013904223;
+		pixels[k] = (uint8_t)(seed >> 24);
+	}
+
+	ScanPlan plan;
+	plan.prepare(cascade, nrows, ncols, ncols, 1.2f, 0.1f, 24.0f, 96.0f);
+
+	int nchecked = 0;
+	for (int n = 0; n < 256 && !plan.scales.empty(); ++n)
+	{
+		seed = 1664525*seed + 1013904223;
+		const ScanScale &scale = plan.scales[(seed >> 8) % plan.scales.size()];
+		if (scale.rows.empty() || scale.cols.empty())
+			continue;
+
+		seed = 1664525*seed + 1013904223;
+		int r = 256*(int)scale.rows[(seed >> 8) % scale.rows.size()];
+		seed = 1664525*seed + 1013904223;
+		int c = 256*(int)scale.cols[(seed >> 8) % scale.cols.size()];
+
+		if (r-cascade.maxr*scale.sr < 0 || c-cascade.maxc*scale.sc < 0 ||
+			r+cascade.maxr*scale.sr >= 256*nrows || c+cascade.maxc*scale.sc >= 256*ncols)
+			continue;
+
+		// both leave the partial sum in o when they reject
+		float o1, o2;
+		int t1 = classify_window(cascade, &o1, r/256, c/256, (int)scale.s, &pixels[0], nrows, ncols, ncols);
+		int t2 = func(&o2, &pixels[r/256*ncols + c/256], &scale.offsets[0]);
+
+		if (t1 != t2 || o1 != o2)
+			return false;
+		++nchecked;
+	}
+
+	return nchecked > 0;
+}
+
+#endif
+
+CascadeJit::CascadeJit() :
+	cascade(0),
+	tables_generation(0),
+	func(0),
+	code(0),
+	codesize(0)
+{}
+
+CascadeJit::~CascadeJit()
+{
+	release();
+}
+
+void CascadeJit::release()
+{
+#ifdef HAVE_X86_64_JIT
+	if (code)
+		munmap(code, codesize);
+#endif
+	cascade = 0;
+	tables_generation = 0;
+	func = 0;
+	code = 0;
+	codesize = 0;
+}
+
+bool CascadeJit::prepare(const CascadeTables &cascade)
+{
+	if (this->cascade == &cascade && tables_generation == cascade.generation)
+		return ready();
+
+	return compile(cascade);
+}
+
+bool CascadeJit::compile(const CascadeTables &cascade)
+{
+	release();
+
+	// kept when the compilation fails too, so that prepare does not retry every frame
+	this->cascade = &cascade;
+	tables_generation = cascade.generation;
+
+#ifdef HAVE_X86_64_JIT
+	if (cascade.ntrees <= 0 || cascade.tdepth <= 0 || cascade.tdepth > 16)
+		return false;
+
+	// most random windows are rejected by the first few trees,
+	// so the code of every tree is first checked with a copy of the cascade that rejects nothing
+	// (the last threshold stays 0 to keep the sum exact)
+	std::vector<float> open_thresholds(cascade.ntrees, -1e30f);
+	open_thresholds[cascade.ntrees-1] = 0.0f;
+
+	CascadeTables open = cascade;
+	open.thresholds = &open_thresholds[0];
+
+	size_t size;
+	void *mem = map_cascade(open, &size);
+	if (!mem)
+		return false;
+
+	bool ok = check_cascade((jit_func)mem, open);
+	munmap(mem, size);
+	if (!ok)
+		return false;
+
+	mem = map_cascade(cascade, &size);
+	if (!mem)
+		return false;
+
+	if (!check_cascade((jit_func)mem, cascade))
+	{
+		munmap(mem, size);
+		return false;
+	}
+
+	func = (jit_func)mem;
+	code = mem;
+	codesize = size;
+
+	return true;
+#else
+	(void)cascade;
+	return false;
+#endif
+}
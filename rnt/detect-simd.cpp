@@ -0,0 +1,484 @@
+#include "detect-simd.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+static void classify_windows_scalar(const CascadeTables &cascade, int *hits, float *qs,
+	int r, const int *cs, int n, int s,
+	const uint8_t *pixels, int nrows, int ncols, int ldim)
+{
+	for (int k = 0; k < n; ++k)
+		hits[k] = classify_window(cascade, &qs[k], r, cs[k], s, pixels, nrows, ncols, ldim);
+}
+
+// evaluates the windows k0..n-1 (the SIMD kernels leave the last few of a row to this one)
+static void evaluate_trees_scalar(const CascadeTables &cascade, int ntrees, const int32_t *offsets,
+	const uint8_t *p, int k0, int n, uint8_t *leaves)
+{
+	const int nnodes = 1<<cascade.tdepth;
+
+	for (int t = 0; t < ntrees; ++t)
+	{
+		const int32_t *off = &offsets[2*t*nnodes];
+		for (int k = k0; k < n; ++k)
+		{
+			int idx = 1;
+			for (int j = 0; j < cascade.tdepth; ++j)
+				idx = 2*idx + (p[k + off[2*idx]] <= p[k + off[2*idx+1]]);
+
+			leaves[t*n + k] = idx - nnodes;
+		}
+	}
+}
+
+static void evaluate_trees_scalar(const CascadeTables &cascade, int ntrees, const int32_t *offsets,
+	const uint8_t *p, int n, uint8_t *leaves)
+{
+	evaluate_trees_scalar(cascade, ntrees, offsets, p, 0, n, leaves);
+}
+
+#ifdef HAVE_X86_SIMD
+
+/*
+	The SIMD kernels keep one window per lane.
+	A lane evaluates one tree per step and as soon as its window is rejected
+	(or accepted by the last tree) it is refilled with the next window of the row,
+	so the lanes stay busy even though the windows die at very different depths.
+*/
+
+#define MAX_LANES 8
+
+struct Lanes
+{
+	int win[MAX_LANES];  // window index, -1 for an idle lane
+	int tree[MAX_LANES];  // tree to be evaluated next
+	int col[MAX_LANES];  // window column times 256
+	float o[MAX_LANES];  // accumulated output
+};
+
+struct RowWindows
+{
+	const int *cs;
+	int n;
+	int next;
+	int sc;
+	int maxc;
+	int ncols;
+};
+
+// next window of the row which passes the image boundary test of the generated code
+static int next_window(RowWindows &row)
+{
+	while (row.next < row.n)
+	{
+		int c = 256*row.cs[row.next++];
+		if ((c+row.maxc*row.sc)/256 < row.ncols && (c-row.maxc*row.sc)/256 >= 0)
+			return row.next - 1;
+	}
+	return -1;
+}
+
+static void start_lane(Lanes &lanes, int k, RowWindows &row)
+{
+	lanes.win[k] = next_window(row);
+	lanes.tree[k] = 0;
+	lanes.o[k] = 0.0f;
+	if (lanes.win[k] >= 0)
+		lanes.col[k] = 256*row.cs[lanes.win[k]];
+}
+
+// idle lanes take the column of an active one, so whatever they compute stays inside the image
+// returns the amount of active lanes
+static int park_idle_lanes(Lanes &lanes, int nlanes)
+{
+	int active = -1;
+	int nactive = 0;
+	for (int k = 0; k < nlanes; ++k)
+		if (lanes.win[k] >= 0)
+		{
+			active = k;
+			++nactive;
+		}
+
+	for (int k = 0; k < nlanes && nactive; ++k)
+		if (lanes.win[k] < 0)
+			lanes.col[k] = lanes.col[active];
+
+	return nactive;
+}
+
+// writes out the windows of the finished lanes and starts new ones in their place
+static int refill_lanes(Lanes &lanes, int nlanes, int finished, int passed,
+	const CascadeTables &cascade, int *hits, float *qs, RowWindows &row)
+{
+	for (int k = 0; k < nlanes; ++k)
+	{
+		if (!(finished>>k & 1))
+			continue;
+
+		if (passed>>k & 1)
+		{
+			hits[lanes.win[k]] = 1;
+			qs[lanes.win[k]] = lanes.o[k] - cascade.thresholds[cascade.ntrees-1];
+		}
+		start_lane(lanes, k, row);
+	}
+
+	return park_idle_lanes(lanes, nlanes);
+}
+
+// sets up a row for the SIMD kernels, returns false if there's nothing left for them to do
+static bool start_row(const CascadeTables &cascade, int *hits, float *qs,
+	int r, const int *cs, int n, int s,
+	const uint8_t *pixels, int nrows, int ncols, int ldim)
+{
+	for (int k = 0; k < n; ++k)
+		hits[k] = -1;
+
+	int sr = (int)(cascade.tsr*s);
+	int top = (256*r-cascade.maxr*sr)/256;
+	int bottom = (256*r+cascade.maxr*sr)/256;
+	if (bottom >= nrows || top < 0)
+		return false;
+
+	// the AVX2 gathers read up to 3 bytes past a pixel, which is only safe above the last row
+	if (bottom >= nrows-1)
+	{
+		classify_windows_scalar(cascade, hits, qs, r, cs, n, s, pixels, nrows, ncols, ldim);
+		return false;
+	}
+
+	return true;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i div256_avx2(__m256i x)
+{
+	// rounds towards zero, like the signed division in the generated code
+	__m256i bias = _mm256_and_si256(_mm256_srai_epi32(x, 31), _mm256_set1_epi32(255));
+	return _mm256_srai_epi32(_mm256_add_epi32(x, bias), 8);
+}
+
+// pixel offsets of (r + t[0]*sr/256, c + t[1]*sc/256) for the packed int16 pairs in t
+__attribute__((target("avx2")))
+static inline __m256i get_offsets_avx2(__m256i t, __m256i r, __m256i c, __m256i sr, __m256i sc, __m256i ldim)
+{
+	__m256i tr = _mm256_srai_epi32(_mm256_slli_epi32(t, 16), 16);
+	__m256i tc = _mm256_srai_epi32(t, 16);
+
+	__m256i row = div256_avx2(_mm256_add_epi32(r, _mm256_mullo_epi32(tr, sr)));
+	__m256i col = div256_avx2(_mm256_add_epi32(c, _mm256_mullo_epi32(tc, sc)));
+
+	return _mm256_add_epi32(_mm256_mullo_epi32(row, ldim), col);
+}
+
+__attribute__((target("avx2")))
+static void classify_windows_avx2(const CascadeTables &cascade, int *hits, float *qs,
+	int r, const int *cs, int n, int s,
+	const uint8_t *pixels, int nrows, int ncols, int ldim)
+{
+	if (!start_row(cascade, hits, qs, r, cs, n, s, pixels, nrows, ncols, ldim))
+		return;
+
+	int sr = (int)(cascade.tsr*s);
+	int sc = (int)(cascade.tsc*s);
+
+	RowWindows row = {cs, n, 0, sc, cascade.maxc, ncols};
+	Lanes lanes;
+	for (int k = 0; k < 8; ++k)
+		start_lane(lanes, k, row);
+	if (!park_idle_lanes(lanes, 8))
+		return;
+
+	const int nnodes = 1<<cascade.tdepth;
+	// every binary test is two int32 words: (r1, c1) and (r2, c2)
+	const int *codes = (const int*)cascade.tcodes;
+
+	const __m256i vr = _mm256_set1_epi32(256*r);
+	const __m256i vsr = _mm256_set1_epi32(sr);
+	const __m256i vsc = _mm256_set1_epi32(sc);
+	const __m256i vldim = _mm256_set1_epi32(ldim);
+	const __m256i vnnodes = _mm256_set1_epi32(nnodes);
+	const __m256i vlast = _mm256_set1_epi32(cascade.ntrees-1);
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256i bytemask = _mm256_set1_epi32(0xFF);
+
+	__m256i vwin = _mm256_loadu_si256((const __m256i*)lanes.win);
+	__m256i vlive = _mm256_cmpgt_epi32(vwin, _mm256_set1_epi32(-1));
+	__m256i vtree = _mm256_loadu_si256((const __m256i*)lanes.tree);
+	__m256i vc = _mm256_loadu_si256((const __m256i*)lanes.col);
+	__m256 o = _mm256_loadu_ps(lanes.o);
+
+	for (;;)
+	{
+		__m256i base = _mm256_mullo_epi32(vtree, vnnodes);
+
+		__m256i idx = one;
+		for (int j = 0; j < cascade.tdepth; ++j)
+		{
+			__m256i node = _mm256_slli_epi32(_mm256_add_epi32(base, idx), 1);
+			__m256i t1 = _mm256_mask_i32gather_epi32(zero, codes, node, vlive, 4);
+			__m256i t2 = _mm256_mask_i32gather_epi32(zero, codes + 1, node, vlive, 4);
+
+			__m256i p1 = get_offsets_avx2(t1, vr, vc, vsr, vsc, vldim);
+			__m256i p2 = get_offsets_avx2(t2, vr, vc, vsr, vsc, vldim);
+
+			__m256i v1 = _mm256_and_si256(_mm256_mask_i32gather_epi32(zero, (const int*)pixels, p1, vlive, 1), bytemask);
+			__m256i v2 = _mm256_and_si256(_mm256_mask_i32gather_epi32(zero, (const int*)pixels, p2, vlive, 1), bytemask);
+
+			// idx = 2*idx + (v1 <= v2)
+			idx = _mm256_add_epi32(_mm256_slli_epi32(idx, 1), _mm256_andnot_si256(_mm256_cmpgt_epi32(v1, v2), one));
+		}
+
+		__m256 lut = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), cascade.luts,
+			_mm256_sub_epi32(_mm256_add_epi32(base, idx), vnnodes), _mm256_castsi256_ps(vlive), 4);
+		o = _mm256_add_ps(o, lut);
+
+		__m256 thr = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), cascade.thresholds,
+			vtree, _mm256_castsi256_ps(vlive), 4);
+		__m256i rejected = _mm256_castps_si256(_mm256_cmp_ps(o, thr, _CMP_LE_OQ));
+		__m256i last = _mm256_cmpeq_epi32(vtree, vlast);
+
+		vtree = _mm256_add_epi32(vtree, one);
+
+		int finished = _mm256_movemask_ps(_mm256_castsi256_ps(
+			_mm256_and_si256(vlive, _mm256_or_si256(rejected, last))));
+		if (!finished)
+			continue;
+
+		int passed = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_andnot_si256(rejected, last)));
+
+		_mm256_storeu_si256((__m256i*)lanes.tree, vtree);
+		_mm256_storeu_ps(lanes.o, o);
+		if (!refill_lanes(lanes, 8, finished, passed, cascade, hits, qs, row))
+			return;
+
+		vwin = _mm256_loadu_si256((const __m256i*)lanes.win);
+		vlive = _mm256_cmpgt_epi32(vwin, _mm256_set1_epi32(-1));
+		vtree = _mm256_loadu_si256((const __m256i*)lanes.tree);
+		vc = _mm256_loadu_si256((const __m256i*)lanes.col);
+		o = _mm256_loadu_ps(lanes.o);
+	}
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128i div256_sse41(__m128i x)
+{
+	__m128i bias = _mm_and_si128(_mm_srai_epi32(x, 31), _mm_set1_epi32(255));
+	return _mm_srai_epi32(_mm_add_epi32(x, bias), 8);
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128i get_offsets_sse41(__m128i t, __m128i r, __m128i c, __m128i sr, __m128i sc, __m128i ldim)
+{
+	__m128i tr = _mm_srai_epi32(_mm_slli_epi32(t, 16), 16);
+	__m128i tc = _mm_srai_epi32(t, 16);
+
+	__m128i row = div256_sse41(_mm_add_epi32(r, _mm_mullo_epi32(tr, sr)));
+	__m128i col = div256_sse41(_mm_add_epi32(c, _mm_mullo_epi32(tc, sc)));
+
+	return _mm_add_epi32(_mm_mullo_epi32(row, ldim), col);
+}
+
+// same as the AVX2 kernel with four lanes, the gathers are done with scalar loads
+__attribute__((target("sse4.1")))
+static void classify_windows_sse41(const CascadeTables &cascade, int *hits, float *qs,
+	int r, const int *cs, int n, int s,
+	const uint8_t *pixels, int nrows, int ncols, int ldim)
+{
+	if (!start_row(cascade, hits, qs, r, cs, n, s, pixels, nrows, ncols, ldim))
+		return;
+
+	int sr = (int)(cascade.tsr*s);
+	int sc = (int)(cascade.tsc*s);
+
+	RowWindows row = {cs, n, 0, sc, cascade.maxc, ncols};
+	Lanes lanes;
+	for (int k = 0; k < 4; ++k)
+		start_lane(lanes, k, row);
+	if (!park_idle_lanes(lanes, 4))
+		return;
+
+	const int nnodes = 1<<cascade.tdepth;
+	const int *codes = (const int*)cascade.tcodes;
+
+	const __m128i vr = _mm_set1_epi32(256*r);
+	const __m128i vsr = _mm_set1_epi32(sr);
+	const __m128i vsc = _mm_set1_epi32(sc);
+	const __m128i vldim = _mm_set1_epi32(ldim);
+	const __m128i one = _mm_set1_epi32(1);
+
+	__m128i vc = _mm_loadu_si128((const __m128i*)lanes.col);
+
+	for (;;)
+	{
+		int base[4];
+		for (int k = 0; k < 4; ++k)
+			base[k] = lanes.tree[k]*nnodes;
+
+		int idx[4] = {1, 1, 1, 1};
+		for (int j = 0; j < cascade.tdepth; ++j)
+		{
+			int n0 = 2*(base[0] + idx[0]);
+			int n1 = 2*(base[1] + idx[1]);
+			int n2 = 2*(base[2] + idx[2]);
+			int n3 = 2*(base[3] + idx[3]);
+
+			__m128i t1 = _mm_setr_epi32(codes[n0], codes[n1], codes[n2], codes[n3]);
+			__m128i t2 = _mm_setr_epi32(codes[n0+1], codes[n1+1], codes[n2+1], codes[n3+1]);
+
+			int p1[4], p2[4];
+			_mm_storeu_si128((__m128i*)p1, get_offsets_sse41(t1, vr, vc, vsr, vsc, vldim));
+			_mm_storeu_si128((__m128i*)p2, get_offsets_sse41(t2, vr, vc, vsr, vsc, vldim));
+
+			__m128i v1 = _mm_setr_epi32(pixels[p1[0]], pixels[p1[1]], pixels[p1[2]], pixels[p1[3]]);
+			__m128i v2 = _mm_setr_epi32(pixels[p2[0]], pixels[p2[1]], pixels[p2[2]], pixels[p2[3]]);
+
+			__m128i vidx = _mm_loadu_si128((const __m128i*)idx);
+			vidx = _mm_add_epi32(_mm_slli_epi32(vidx, 1), _mm_andnot_si128(_mm_cmpgt_epi32(v1, v2), one));
+			_mm_storeu_si128((__m128i*)idx, vidx);
+		}
+
+		int finished = 0;
+		int passed = 0;
+		for (int k = 0; k < 4; ++k)
+		{
+			if (lanes.win[k] < 0)
+				continue;
+
+			lanes.o[k] += cascade.luts[base[k] + idx[k] - nnodes];
+
+			bool rejected = lanes.o[k] <= cascade.thresholds[lanes.tree[k]];
+			bool last = lanes.tree[k] == cascade.ntrees-1;
+			if (rejected || last)
+				finished |= 1 << k;
+			if (!rejected && last)
+				passed |= 1 << k;
+
+			++lanes.tree[k];
+		}
+
+		if (!finished)
+			continue;
+
+		if (!refill_lanes(lanes, 4, finished, passed, cascade, hits, qs, row))
+			return;
+		vc = _mm_loadu_si128((const __m128i*)lanes.col);
+	}
+}
+
+/*
+	The dense tree evaluators keep the node index of one window per byte lane: at every level, the node
+	tests of all the nodes of that level are evaluated for all the lanes (a <= b is min(a, b) == a),
+	and every lane picks the result of its own node. The indices stay below 256 for depths up to 7.
+*/
+
+__attribute__((target("avx2")))
+static void evaluate_trees_avx2(const CascadeTables &cascade, int ntrees, const int32_t *offsets,
+	const uint8_t *p, int n, uint8_t *leaves)
+{
+	const int tdepth = cascade.tdepth;
+	const int nnodes = 1<<tdepth;
+	if (tdepth > 7)
+	{
+		evaluate_trees_scalar(cascade, ntrees, offsets, p, n, leaves);
+		return;
+	}
+
+	int k = 0;
+	for (; k + 32 <= n; k += 32)
+		for (int t = 0; t < ntrees; ++t)
+		{
+			const int32_t *off = &offsets[2*t*nnodes];
+
+			__m256i idx = _mm256_set1_epi8(1);
+			for (int j = 0; j < tdepth; ++j)
+			{
+				__m256i bit = _mm256_setzero_si256();
+				for (int node = 1<<j; node < 2<<j; ++node)
+				{
+					const __m256i a = _mm256_loadu_si256((const __m256i*)&p[k + off[2*node]]);
+					const __m256i b = _mm256_loadu_si256((const __m256i*)&p[k + off[2*node+1]]);
+					const __m256i le = _mm256_cmpeq_epi8(_mm256_min_epu8(a, b), a);
+
+					bit = _mm256_or_si256(bit, _mm256_and_si256(_mm256_cmpeq_epi8(idx, _mm256_set1_epi8(node)), le));
+				}
+
+				// bit is 0 or -1
+				idx = _mm256_sub_epi8(_mm256_add_epi8(idx, idx), bit);
+			}
+
+			_mm256_storeu_si256((__m256i*)&leaves[t*n + k], _mm256_sub_epi8(idx, _mm256_set1_epi8(nnodes)));
+		}
+
+	evaluate_trees_scalar(cascade, ntrees, offsets, p, k, n, leaves);
+}
+
+__attribute__((target("sse2")))
+static void evaluate_trees_sse2(const CascadeTables &cascade, int ntrees, const int32_t *offsets,
+	const uint8_t *p, int n, uint8_t *leaves)
+{
+	const int tdepth = cascade.tdepth;
+	const int nnodes = 1<<tdepth;
+	if (tdepth > 7)
+	{
+		evaluate_trees_scalar(cascade, ntrees, offsets, p, n, leaves);
+		return;
+	}
+
+	int k = 0;
+	for (; k + 16 <= n; k += 16)
+		for (int t = 0; t < ntrees; ++t)
+		{
+			const int32_t *off = &offsets[2*t*nnodes];
+
+			__m128i idx = _mm_set1_epi8(1);
+			for (int j = 0; j < tdepth; ++j)
+			{
+				__m128i bit = _mm_setzero_si128();
+				for (int node = 1<<j; node < 2<<j; ++node)
+				{
+					const __m128i a = _mm_loadu_si128((const __m128i*)&p[k + off[2*node]]);
+					const __m128i b = _mm_loadu_si128((const __m128i*)&p[k + off[2*node+1]]);
+					const __m128i le = _mm_cmpeq_epi8(_mm_min_epu8(a, b), a);
+
+					bit = _mm_or_si128(bit, _mm_and_si128(_mm_cmpeq_epi8(idx, _mm_set1_epi8(node)), le));
+				}
+
+				idx = _mm_sub_epi8(_mm_add_epi8(idx, idx), bit);
+			}
+
+			_mm_storeu_si128((__m128i*)&leaves[t*n + k], _mm_sub_epi8(idx, _mm_set1_epi8(nnodes)));
+		}
+
+	evaluate_trees_scalar(cascade, ntrees, offsets, p, k, n, leaves);
+}
+
+#endif // HAVE_X86_SIMD
+
+batch_classifier get_batch_classifier()
+{
+#ifdef HAVE_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return classify_windows_avx2;
+	if (__builtin_cpu_supports("sse4.1"))
+		return classify_windows_sse41;
+#endif
+	return classify_windows_scalar;
+}
+
+dense_tree_evaluator get_dense_tree_evaluator()
+{
+#ifdef HAVE_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return evaluate_trees_avx2;
+	if (__builtin_cpu_supports("sse2"))
+		return evaluate_trees_sse2;
+#endif
+	return evaluate_trees_scalar;
+}
@@ -0,0 +1,26 @@
+#ifndef DETECTSIMD_H
+#define DETECTSIMD_H
+
+#include "picornt.h"
+
+// classifies the n windows of size s centred at (r, cs[0..n-1])
+// hits[k] is set to 1 for the windows that passed the cascade (their outputs go to qs[k])
+// and to -1 for the rest
+typedef void (*batch_classifier)(const CascadeTables &cascade, int *hits, float *qs,
+	int r, const int *cs, int n, int s,
+	const uint8_t *pixels, int nrows, int ncols, int ldim);
+
+// the fastest batch classifier supported by the CPU we're running on
+batch_classifier get_batch_classifier();
+
+// computes the leaves reached in the first ntrees trees by the windows centred at the n consecutive pixels
+// p[0..n-1] of one row, with the binary tests given as pixel offsets (see ScanScale), into leaves[t*n + k]
+// every node test of a tree is evaluated for all the windows at once, as a comparison of two shifted rows
+// (the tree depth must be at most 8)
+typedef void (*dense_tree_evaluator)(const CascadeTables &cascade, int ntrees, const int32_t *offsets,
+	const uint8_t *p, int n, uint8_t *leaves);
+
+// the fastest dense tree evaluator supported by the CPU we're running on
+dense_tree_evaluator get_dense_tree_evaluator();
+
+#endif // DETECTSIMD_H
@@ -0,0 +1,194 @@
+#include "picornt.h"
+#include "work-pool.h"
+
+#include <algorithm>
+#include <vector>
+
+// roughly how many windows one task of find_objects_batch should evaluate
+#define BATCH_TASK_WINDOWS 4096
+
+void BatchDetections::reset(const int *counts, int nimages)
+{
+	starts.resize(nimages);
+	capacities.assign(counts, counts + nimages);
+	this->counts.assign(counts, counts + nimages);
+
+	// rs, cs, ss and qs of every image one after the other
+	size_t size = 0;
+	for (int i = 0; i < nimages; ++i)
+	{
+		starts[i] = size;
+		size += 4*(size_t)counts[i];
+	}
+
+	// resize() keeps the capacity, so the arena is only reallocated when a batch needs more
+	arena.resize(std::max(size, (size_t)1));
+}
+
+// windows of rows [row0, row1) of one scale of an image
+struct BatchUnit
+{
+	int image;
+	float s;
+	int row0;
+	int row1;
+};
+
+struct BatchTask
+{
+	int unit0;
+	int unit1;
+	std::vector<int> images;
+	std::vector<float> dets;  // (r, c, s, q) quadruples
+};
+
+// number of window centres along an axis, accumulated exactly as in find_objects
+static int get_scan_count(float s, float step, int n)
+{
+	int count = 0;
+	for (float p = s/2+1; p <= n-s/2-1; p += step)
+		++count;
+
+	return count;
+}
+
+int find_objects_batch(BatchDetections &detections, int maxndetections,
+	int (*detection_func)(float*, int, int, int, const uint8_t*, int, int, int),
+	const BatchImage *images, int nimages,
+	float scalefactor, float stridefactor, bool cluster, WorkStealingPool &pool)
+{
+	nimages = std::max(0, nimages);
+	maxndetections = std::max(0, maxndetections);
+
+	// the scan is cut into units of at most BATCH_TASK_WINDOWS windows (but at least one row),
+	// listed in the serial scan order of every image
+	std::vector<BatchUnit> units;
+	std::vector<int> nwindows;
+	std::vector<int> firstunits(nimages);  // of every image
+	for (int i = 0; i < nimages && maxndetections > 0; ++i)
+	{
+		const BatchImage &image = images[i];
+		firstunits[i] = units.size();
+		for (float s = image.minsize; s <= image.maxsize; s *= scalefactor)
+		{
+			const float d = std::max(stridefactor * s, 1.0f);
+			const int nr = get_scan_count(s, d, image.nrows);
+			const int nc = get_scan_count(s, d, image.ncols);
+			if (!nr || !nc)
+				continue;
+
+			const int band = std::max(1, BATCH_TASK_WINDOWS / nc);
+			for (int r = 0; r < nr; r += band)
+			{
+				BatchUnit unit = {i, s, r, std::min(nr, r + band)};
+				units.push_back(unit);
+				nwindows.push_back((unit.row1 - unit.row0)*nc);
+			}
+		}
+	}
+
+	// consecutive units make up a task, so that small images get grouped together
+	std::vector<BatchTask> tasks;
+	for (int u = 0; u < (int)units.size(); )
+	{
+		tasks.push_back(BatchTask());
+		tasks.back().unit0 = u;
+
+		int n = 0;
+		while (u < (int)units.size() && n < BATCH_TASK_WINDOWS)
+			n += nwindows[u++];
+		tasks.back().unit1 = u;
+	}
+
+	OrderedCounts found(units.size());
+	pool.run_in_order(tasks.size(), [&](int t)
+	{
+		BatchTask &task = tasks[t];
+
+		for (int u = task.unit0; u < task.unit1; ++u)
+		{
+			const BatchUnit &unit = units[u];
+			const BatchImage &im = images[unit.image];
+
+			// if the units before this one are done and already have enough detections,
+			// this one can't make it into the output anyway
+			const int before = found.get_before(firstunits[unit.image], u, maxndetections);
+			const int maxn = maxndetections - before;
+
+			int ndetections = 0;
+			if (maxn > 0)
+			{
+				const float s = unit.s;
+				const float dr = std::max(stridefactor * s, 1.0f);
+				const float dc = dr;
+
+				int i = 0;
+				for (float r = s/2+1; r <= im.nrows-s/2-1 && i < unit.row1 && ndetections < maxn; r += dr, ++i)
+				{
+					if (i < unit.row0)
+						continue;
+
+					for (float c = s/2+1; c <= im.ncols-s/2-1 && ndetections < maxn; c += dc)
+					{
+						float q;
+						if (detection_func(&q, r, c, s, im.pixels, im.nrows, im.ncols, im.ldim) != 1)
+							continue;
+
+						task.images.push_back(unit.image);
+						task.dets.push_back(r);
+						task.dets.push_back(c);
+						task.dets.push_back(s);
+						task.dets.push_back(q);
+						++ndetections;
+					}
+				}
+			}
+
+			found.set(u, ndetections);
+		}
+	});
+
+	// the tasks are in scan order, so merging them in order gives the output of find_objects for every image
+	std::vector<int> counts(nimages, 0);
+	for (size_t t = 0; t < tasks.size(); ++t)
+		for (size_t k = 0; k < tasks[t].images.size(); ++k)
+		{
+			int &n = counts[tasks[t].images[k]];
+			n = std::min(n + 1, maxndetections);
+		}
+
+	detections.reset(nimages ? &counts[0] : 0, nimages);
+
+	std::fill(counts.begin(), counts.end(), 0);
+	for (size_t t = 0; t < tasks.size(); ++t)
+	{
+		const BatchTask &task = tasks[t];
+		for (size_t k = 0; k < task.images.size(); ++k)
+		{
+			const int i = task.images[k];
+			if (counts[i] >= detections.ndetections(i))
+				continue;
+
+			detections.rs(i)[counts[i]] = task.dets[4*k + 0];
+			detections.cs(i)[counts[i]] = task.dets[4*k + 1];
+			detections.ss(i)[counts[i]] = task.dets[4*k + 2];
+			detections.qs(i)[counts[i]] = task.dets[4*k + 3];
+			++counts[i];
+		}
+	}
+
+	if (cluster)
+	{
+		pool.run(nimages, [&](int i)
+		{
+			detections.set_ndetections(i, cluster_detections(
+				detections.rs(i), detections.cs(i), detections.ss(i), detections.qs(i), detections.ndetections(i)));
+		});
+	}
+
+	int ndetections = 0;
+	for (int i = 0; i < nimages; ++i)
+		ndetections += detections.ndetections(i);
+
+	return ndetections;
+}
@@ -0,0 +1,248 @@
+#ifndef FIND_OBJECTS_H
+#define FIND_OBJECTS_H
+
+#include "picornt.h"
+
+#include <algorithm>
+#include <climits>
+
+/*
+	find_objects with the classifier given as a type, so that it can be inlined into the scan loop.
+
+	A classifier is anything with the following members:
+
+		// called once per scale, before the windows of that scale are visited
+		// sets the range of window centres (in pixels) the classifier can evaluate,
+		// windows outside of it are skipped without a call
+		void set_scale(int s, int nrows, int ncols, int *rmin, int *rmax, int *cmin, int *cmax);
+
+		// classifies the window of the current scale centred at (r, c)
+		int operator()(float *o, int r, int c, const uint8_t *pixels, int ldim);
+
+	The windows visited (and detections returned) are the same as with the function-pointer find_objects.
+	(the second template parameter only keeps this overload away from the non-template ones)
+*/
+
+// visits the windows and passes the positive ones to sink(r, c, s, q), until it returns false
+template <typename Classifier, typename Sink>
+void scan_windows(Classifier &classifier, Sink &sink,
+	const uint8_t *pixels, int nrows, int ncols, int ldim,
+	float scalefactor, float stridefactor, float minsize, float maxsize)
+{
+	for (float s = minsize; s <= maxsize; s *= scalefactor)
+	{
+		float dr = std::max(stridefactor * s, 1.0f);
+		float dc = dr;
+
+		int rmin, rmax, cmin, cmax;
+		classifier.set_scale((int)s, nrows, ncols, &rmin, &rmax, &cmin, &cmax);
+
+		// the column positions are the same for every row,
+		// so find the first one inside and the amount of them once per scale
+		float c0 = s/2+1;
+		while (c0 <= ncols-s/2-1 && (int)c0 < cmin)
+			c0 += dc;
+
+		int n = 0;
+		for (float c = c0; c <= ncols-s/2-1 && (int)c <= cmax; c += dc)
+			++n;
+
+		for (float r = s/2+1; r <= nrows-s/2-1; r += dr)
+		{
+			if ((int)r < rmin)
+				continue;
+			if ((int)r > rmax)
+				break;
+
+			float c = c0;
+			for (int j = 0; j < n; ++j, c += dc)
+			{
+				float q;
+				if (classifier(&q, (int)r, (int)c, pixels, ldim) != 1)
+					continue;
+
+				if (!sink(r, c, s, q))
+					return;
+			}
+		}
+	}
+}
+
+// sink writing the detections into arrays
+struct DetectionArrays
+{
+	float *rs, *cs, *ss, *qs;
+	int maxndetections;
+	int ndetections;
+
+	bool operator()(float r, float c, float s, float q)
+	{
+		if (ndetections >= maxndetections)
+			return false;
+
+		qs[ndetections] = q;
+		rs[ndetections] = r;
+		cs[ndetections] = c;
+		ss[ndetections] = s;
+		++ndetections;
+
+		return ndetections < maxndetections;
+	}
+};
+
+// sink adding the detections to streaming clusters
+struct DetectionClustersSink
+{
+	DetectionClusters &clusters;
+
+	bool operator()(float r, float c, float s, float q)
+	{
+		clusters.add(r, c, s, q);
+		return true;
+	}
+};
+
+template <typename Classifier, typename = decltype(&Classifier::set_scale)>
+int find_objects(float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	Classifier &classifier,
+	const uint8_t *pixels, int nrows, int ncols, int ldim,
+	float scalefactor, float stridefactor, float minsize, float maxsize)
+{
+	if (maxndetections <= 0)
+		return 0;
+
+	DetectionArrays sink = {rs, cs, ss, qs, maxndetections, 0};
+	scan_windows(classifier, sink, pixels, nrows, ncols, ldim, scalefactor, stridefactor, minsize, maxsize);
+
+	return sink.ndetections;
+}
+
+// same, but the detections are merged into clusters as they are found, see DetectionClusters
+// the clusters of an earlier call are dropped first
+template <typename Classifier, typename = decltype(&Classifier::set_scale)>
+int find_objects(DetectionClusters &clusters,
+	Classifier &classifier,
+	const uint8_t *pixels, int nrows, int ncols, int ldim,
+	float scalefactor, float stridefactor, float minsize, float maxsize)
+{
+	clusters.clear();
+
+	DetectionClustersSink sink = {clusters};
+	scan_windows(classifier, sink, pixels, nrows, ncols, ldim, scalefactor, stridefactor, minsize, maxsize);
+
+	return clusters.size();
+}
+
+// classifier calling a function generated by picogen (or one with the same signature)
+// F is a template parameter, so the compiler can inline it
+template <int (*F)(float*, int, int, int, const uint8_t*, int, int, int)>
+struct GeneratedClassifier
+{
+	int s, nrows, ncols;
+
+	void set_scale(int s, int nrows, int ncols, int *rmin, int *rmax, int *cmin, int *cmax)
+	{
+		this->s = s;
+		this->nrows = nrows;
+		this->ncols = ncols;
+
+		// the generated function checks the bounds itself
+		*rmin = *cmin = INT_MIN;
+		*rmax = *cmax = INT_MAX;
+	}
+
+	int operator()(float *o, int r, int c, const uint8_t *pixels, int ldim) const
+	{
+		return F(o, r, c, s, pixels, nrows, ncols, ldim);
+	}
+};
+
+// same as GeneratedClassifier, for a function only known at run time
+struct FunctionClassifier
+{
+	int (*func)(float*, int, int, int, const uint8_t*, int, int, int);
+	int s, nrows, ncols;
+
+	explicit FunctionClassifier(int (*func)(float*, int, int, int, const uint8_t*, int, int, int)) :
+		func(func), s(0), nrows(0), ncols(0)
+	{}
+
+	void set_scale(int s, int nrows, int ncols, int *rmin, int *rmax, int *cmin, int *cmax)
+	{
+		this->s = s;
+		this->nrows = nrows;
+		this->ncols = ncols;
+
+		*rmin = *cmin = INT_MIN;
+		*rmax = *cmax = INT_MAX;
+	}
+
+	int operator()(float *o, int r, int c, const uint8_t *pixels, int ldim) const
+	{
+		return func(o, r, c, s, pixels, nrows, ncols, ldim);
+	}
+};
+
+// leaf output of tree i for the window centred at (r, c), given in 1/256 of a pixel
+// D is the tree depth, 0 if it is only known at run time
+template <int D>
+inline float get_tree_output(const CascadeTables &cascade, int i,
+	int r, int c, int sr, int sc, const uint8_t *pixels, int ldim)
+{
+	const int tdepth = D ? D : cascade.tdepth;
+	const int nnodes = 1<<tdepth;
+	const int16_t (*tcodes)[4] = &cascade.tcodes[i*nnodes];
+
+	int idx = 1;
+	for (int j = 0; j < tdepth; ++j)
+		idx = 2*idx + (pixels[(r+tcodes[idx][0]*sr)/256*ldim + (c+tcodes[idx][1]*sc)/256] <=
+			pixels[(r+tcodes[idx][2]*sr)/256*ldim + (c+tcodes[idx][3]*sc)/256]);
+
+	return cascade.luts[i*nnodes + idx - nnodes];
+}
+
+// classifier evaluating cascade tables, same results as the function picogen generates from them
+// the window size of the binary tests and the bounds are computed once per scale
+template <int D = 0>
+struct TablesClassifier
+{
+	const CascadeTables &cascade;
+	int sr, sc;
+
+	explicit TablesClassifier(const CascadeTables &cascade) :
+		cascade(cascade), sr(0), sc(0)
+	{}
+
+	void set_scale(int s, int nrows, int ncols, int *rmin, int *rmax, int *cmin, int *cmax)
+	{
+		sr = (int)(cascade.tsr*s);
+		sc = (int)(cascade.tsc*s);
+
+		// (256*r - maxr*sr)/256 >= 0 and (256*r + maxr*sr)/256 < nrows
+		*rmin = cascade.maxr*sr/256;
+		*rmax = nrows - 1 - cascade.maxr*sr/256;
+		*cmin = cascade.maxc*sc/256;
+		*cmax = ncols - 1 - cascade.maxc*sc/256;
+	}
+
+	int operator()(float *o, int r, int c, const uint8_t *pixels, int ldim) const
+	{
+		r *= 256;
+		c *= 256;
+
+		*o = 0.0f;
+		for (int i = 0; i < cascade.ntrees; ++i)
+		{
+			*o += get_tree_output<D>(cascade, i, r, c, sr, sc, pixels, ldim);
+
+			if (*o <= cascade.thresholds[i])
+				return -1;
+		}
+
+		*o -= cascade.thresholds[cascade.ntrees-1];
+
+		return 1;
+	}
+};
+
+#endif // FIND_OBJECTS_H
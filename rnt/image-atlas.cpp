@@ -0,0 +1,201 @@
+#include "picornt.h"
+#include "find-objects.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+ImageAtlas::ImageAtlas() :
+	rows(0),
+	cols(0)
+{}
+
+void ImageAtlas::pack(const BatchImage *images, int nimages, int guard, int width)
+{
+	guard = std::max(0, guard);
+	nimages = std::max(0, nimages);
+
+	if (width <= 0)
+	{
+		double area = 0.0;
+		for (int i = 0; i < nimages; ++i)
+		{
+			area += (double)(images[i].nrows + guard)*(images[i].ncols + guard);
+			width = std::max(width, images[i].ncols + 2*guard);
+		}
+		width = std::max(width, (int)std::sqrt(area));
+	}
+
+	// shelves of images, left to right and top to bottom, with guard pixels around every one
+	slots.resize(nimages);
+	shelves.clear();
+
+	int row = guard;
+	int col = guard;
+	int height = 0;
+	cols = 1;
+	for (int i = 0; i < nimages; ++i)
+	{
+		if (col > guard && col + images[i].ncols + guard > width)
+		{
+			row += height + guard;
+			col = guard;
+			height = 0;
+		}
+
+		if (col == guard)
+		{
+			Shelf shelf = {row, i, i};
+			shelves.push_back(shelf);
+		}
+
+		Slot slot = {row, col, images[i].nrows, images[i].ncols};
+		slots[i] = slot;
+		shelves.back().slot1 = i + 1;
+
+		col += images[i].ncols + guard;
+		height = std::max(height, images[i].nrows);
+		cols = std::max(cols, col);
+	}
+	rows = row + height + guard;
+
+	// the shelf of every row and the slot of every column of a shelf, -1 above the first ones
+	rowshelves.assign(rows, -1);
+	for (size_t k = 0; k < shelves.size(); ++k)
+	{
+		const int end = k+1 < shelves.size() ? shelves[k+1].row : rows;
+		std::fill(rowshelves.begin() + shelves[k].row, rowshelves.begin() + end, (int)k);
+	}
+
+	shelfslots.assign(shelves.size()*cols, -1);
+	for (size_t k = 0; k < shelves.size(); ++k)
+		for (int i = shelves[k].slot0; i < shelves[k].slot1; ++i)
+		{
+			const int end = i+1 < shelves[k].slot1 ? slots[i+1].col : cols;
+			std::fill(shelfslots.begin() + k*cols + slots[i].col, shelfslots.begin() + k*cols + end, i);
+		}
+
+	// assign() keeps the capacity, so the buffer is only reallocated when a batch needs more
+	buffer.assign((size_t)rows*cols, 0);
+	for (int i = 0; i < nimages; ++i)
+		for (int r = 0; r < slots[i].nrows; ++r)
+			memcpy(&buffer[(size_t)(slots[i].row + r)*cols + slots[i].col],
+				&images[i].pixels[(size_t)r*images[i].ldim], slots[i].ncols);
+}
+
+bool ImageAtlas::find(float r, float c, float s, const CascadeTables &cascade, int *image, float *ir, float *ic) const
+{
+	const int ri = (int)r;
+	const int ci = (int)c;
+
+	// the image whose slot starts closest above and to the left of the centre
+	if (ri < 0 || ri >= rows || ci < 0 || ci >= cols || rowshelves[ri] < 0)
+		return false;
+
+	const int k = shelfslots[(size_t)rowshelves[ri]*cols + ci];
+	if (k < 0)
+		return false;
+	const Slot &slot = slots[k];
+
+	// the same bounds as find_objects on the image, except that no test may round up into row or column 0
+	// from the guard band (find_objects on the image rounds toward zero there, the atlas does not)
+	const int sr = (int)(cascade.tsr*(int)s);
+	const int sc = (int)(cascade.tsc*(int)s);
+	const int r0 = 256*(ri - slot.row);
+	const int c0 = 256*(ci - slot.col);
+	if (r0 - cascade.maxr*sr < 0 || (r0 + cascade.maxr*sr)/256 >= slot.nrows ||
+		c0 - cascade.maxc*sc < 0 || (c0 + cascade.maxc*sc)/256 >= slot.ncols)
+		return false;
+
+	*image = k;
+	*ir = r - slot.row;
+	*ic = c - slot.col;
+
+	return true;
+}
+
+// classifier skipping the windows that do not lie inside one image of the atlas
+struct AtlasClassifier
+{
+	const ImageAtlas &atlas;
+	TablesClassifier<> tables;
+	int s;
+
+	AtlasClassifier(const ImageAtlas &atlas, const CascadeTables &cascade) :
+		atlas(atlas), tables(cascade), s(0)
+	{}
+
+	void set_scale(int s, int nrows, int ncols, int *rmin, int *rmax, int *cmin, int *cmax)
+	{
+		this->s = s;
+		tables.set_scale(s, nrows, ncols, rmin, rmax, cmin, cmax);
+	}
+
+	int operator()(float *o, int r, int c, const uint8_t *pixels, int ldim) const
+	{
+		int i;
+		float ir, ic;
+		if (!atlas.find(r, c, s, tables.cascade, &i, &ir, &ic))
+			return -1;
+
+		return tables(o, r, c, pixels, ldim);
+	}
+};
+
+// sink moving the detections of an atlas scan back to their images
+struct AtlasSink
+{
+	const ImageAtlas &atlas;
+	const CascadeTables &cascade;
+	const BatchImage *images;
+	float *rs, *cs, *ss, *qs;
+	int *indices;
+	int maxndetections;
+	int ndetections;
+
+	bool operator()(float r, float c, float s, float q)
+	{
+		int i;
+		float ir, ic;
+		if (!atlas.find(r, c, s, cascade, &i, &ir, &ic) || s < images[i].minsize || s > images[i].maxsize)
+			return true;
+
+		qs[ndetections] = q;
+		rs[ndetections] = ir;
+		cs[ndetections] = ic;
+		ss[ndetections] = s;
+		indices[ndetections] = i;
+		++ndetections;
+
+		return ndetections < maxndetections;
+	}
+};
+
+int find_objects_atlas(float *rs, float *cs, float *ss, float *qs, int *indices, int maxndetections,
+	ImageAtlas &atlas, const CascadeTables &cascade,
+	const BatchImage *images, int nimages,
+	float scalefactor, float stridefactor)
+{
+	if (nimages <= 0 || maxndetections <= 0)
+		return 0;
+
+	float minsize = images[0].minsize;
+	float maxsize = images[0].maxsize;
+	for (int i = 1; i < nimages; ++i)
+	{
+		minsize = std::min(minsize, images[i].minsize);
+		maxsize = std::max(maxsize, images[i].maxsize);
+	}
+
+	// no binary test of a window inside an image reaches past the guard band around it
+	const int sr = (int)(cascade.tsr*(int)maxsize);
+	const int sc = (int)(cascade.tsc*(int)maxsize);
+	atlas.pack(images, nimages, std::max(cascade.maxr*sr, cascade.maxc*sc)/256 + 1, 0);
+
+	AtlasClassifier classifier(atlas, cascade);
+	AtlasSink sink = {atlas, cascade, images, rs, cs, ss, qs, indices, maxndetections, 0};
+	scan_windows(classifier, sink, atlas.pixels(), atlas.nrows(), atlas.ncols(), atlas.ldim(),
+		scalefactor, stridefactor, minsize, maxsize);
+
+	return sink.ndetections;
+}
@@ -0,0 +1,173 @@
+#include "picornt.h"
+
+#include <algorithm>
+
+// window centres along one image axis, accumulated exactly as in find_objects
+static void get_scan_positions(std::vector<float> &ps, float s, float step, int n)
+{
+	ps.clear();
+	for (float p = s/2+1; p <= n-s/2-1; p += step)
+		ps.push_back(p);
+}
+
+// positions [first, last) of the windows of size s whose pixels, from (int)(p-s/2)-1 to (int)(p+s/2)+1,
+// overlap [p0, p1)
+static void get_window_range(const std::vector<float> &ps, float s, int p0, int p1, int *first, int *last)
+{
+	*first = std::partition_point(ps.begin(), ps.end(), [&](float p) { return (int)(p + s/2) + 1 < p0; }) - ps.begin();
+	*last = std::partition_point(ps.begin(), ps.end(), [&](float p) { return (int)(p - s/2) - 1 < p1; }) - ps.begin();
+}
+
+IncrementalDetector::IncrementalDetector() :
+	nrows(0), ncols(0),
+	scalefactor(0.0f), stridefactor(0.0f), minsize(0.0f), maxsize(0.0f),
+	complete(false),
+	nclassified(0)
+{}
+
+void IncrementalDetector::reset()
+{
+	complete = false;
+}
+
+int IncrementalDetector::detect(float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	int (*detection_func)(float*, int, int, int, const uint8_t*, int, int, int),
+	const uint8_t *pixels, int nrows, int ncols, int ldim,
+	const int *rects, int nrects,
+	float scalefactor, float stridefactor, float minsize, float maxsize)
+{
+	if (nrows != this->nrows || ncols != this->ncols || scalefactor != this->scalefactor ||
+		stridefactor != this->stridefactor || minsize != this->minsize || maxsize != this->maxsize)
+	{
+		this->nrows = nrows;
+		this->ncols = ncols;
+		this->scalefactor = scalefactor;
+		this->stridefactor = stridefactor;
+		this->minsize = minsize;
+		this->maxsize = maxsize;
+
+		scales.clear();
+		for (float s = minsize; s <= maxsize; s *= scalefactor)
+		{
+			float dr = std::max(stridefactor * s, 1.0f);
+			float dc = dr;
+
+			scales.push_back(Scale());
+			scales.back().s = s;
+			get_scan_positions(scales.back().rows, s, dr, nrows);
+			get_scan_positions(scales.back().cols, s, dc, ncols);
+		}
+
+		complete = false;
+	}
+
+	// the results of the last frame can only be reused if they are all there
+	const int all[4] = {0, 0, nrows, ncols};
+	if (!complete)
+	{
+		rects = all;
+		nrects = 1;
+	}
+
+	// the detections of the last frame, in scan order
+	windows[0].swap(windows[1]);
+	qualities[0].swap(qualities[1]);
+	const std::vector<int> &prev = windows[1];
+	const std::vector<float> &prevqs = qualities[1];
+	size_t p = 0;
+
+	windows[0].clear();
+	qualities[0].clear();
+	nclassified = 0;
+
+	// windows [i0, i1) x [j0, j1) of the current scale overlapping a rectangle
+	std::vector<int> ranges;
+	// column ranges [j0, j1) of the current row
+	std::vector<std::pair<int, int> > spans;
+
+	int ndetections = 0;
+	for (int k = 0; k < (int)scales.size() && ndetections < maxndetections; ++k)
+	{
+		const Scale &scale = scales[k];
+
+		ranges.clear();
+		for (int q = 0; q < nrects; ++q)
+		{
+			const int *rect = &rects[4*q];
+
+			int i0, i1, j0, j1;
+			get_window_range(scale.rows, scale.s, rect[0], rect[0] + rect[2], &i0, &i1);
+			get_window_range(scale.cols, scale.s, rect[1], rect[1] + rect[3], &j0, &j1);
+			if (i0 >= i1 || j0 >= j1)
+				continue;
+
+			ranges.push_back(i0);
+			ranges.push_back(i1);
+			ranges.push_back(j0);
+			ranges.push_back(j1);
+		}
+
+		for (int i = 0; i < (int)scale.rows.size() && ndetections < maxndetections; ++i)
+		{
+			spans.clear();
+			for (size_t q = 0; q < ranges.size(); q += 4)
+				if (i >= ranges[q+0] && i < ranges[q+1])
+					spans.push_back(std::make_pair(ranges[q+2], ranges[q+3]));
+			std::sort(spans.begin(), spans.end());
+			spans.push_back(std::make_pair((int)scale.cols.size(), (int)scale.cols.size()));
+
+			// the detections of the last frame before this row are of windows that are gone
+			while (p < prev.size() && (prev[p] < k || (prev[p] == k && prev[p+1] < i)))
+				p += 3;
+
+			// the old detections left of every span are kept, the windows of the span are classified again
+			int j = 0;
+			for (size_t q = 0; q < spans.size() && ndetections < maxndetections; ++q)
+			{
+				const int j0 = std::max(j, spans[q].first);
+				const int j1 = std::max(j, spans[q].second);
+
+				for (; p < prev.size() && prev[p] == k && prev[p+1] == i && prev[p+2] < j1 && ndetections < maxndetections; p += 3)
+				{
+					if (prev[p+2] >= j0)
+						continue;
+
+					windows[0].push_back(k);
+					windows[0].push_back(i);
+					windows[0].push_back(prev[p+2]);
+					qualities[0].push_back(prevqs[p/3]);
+
+					qs[ndetections] = prevqs[p/3];
+					rs[ndetections] = scale.rows[i];
+					cs[ndetections] = scale.cols[prev[p+2]];
+					ss[ndetections] = scale.s;
+					++ndetections;
+				}
+
+				for (j = j0; j < j1 && ndetections < maxndetections; ++j)
+				{
+					float o;
+					++nclassified;
+					if (detection_func(&o, scale.rows[i], scale.cols[j], scale.s, pixels, nrows, ncols, ldim) != 1)
+						continue;
+
+					windows[0].push_back(k);
+					windows[0].push_back(i);
+					windows[0].push_back(j);
+					qualities[0].push_back(o);
+
+					qs[ndetections] = o;
+					rs[ndetections] = scale.rows[i];
+					cs[ndetections] = scale.cols[j];
+					ss[ndetections] = scale.s;
+					++ndetections;
+				}
+			}
+		}
+	}
+
+	// the scan may have been cut short
+	complete = ndetections < maxndetections;
+
+	return ndetections;
+}
@@ -0,0 +1,186 @@
+#include "picornt.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+// sum of the absolute differences of n pixels
+static int get_row_sad(const uint8_t *a, const uint8_t *b, int n)
+{
+	int sum = 0;
+	int c = 0;
+
+#ifdef HAVE_SSE2
+	for (; c + 16 <= n; c += 16)
+	{
+		__m128i sad = _mm_sad_epu8(_mm_loadu_si128((const __m128i*)&a[c]), _mm_loadu_si128((const __m128i*)&b[c]));
+		sum += _mm_cvtsi128_si32(sad) + _mm_extract_epi16(sad, 4);
+	}
+#endif
+
+	for (; c < n; ++c)
+		sum += a[c] > b[c] ? a[c] - b[c] : b[c] - a[c];
+
+	return sum;
+}
+
+MotionGate::MotionGate() :
+	threshold(0.0f),
+	refresh(0),
+	nrows(0), ncols(0),
+	nbrows(0), nbcols(0),
+	scalefactor(0.0f), stridefactor(0.0f), minsize(0.0f), maxsize(0.0f),
+	frame(0),
+	complete(false),
+	nchanged(0),
+	nclassified(0)
+{}
+
+void MotionGate::configure(float threshold, int refresh)
+{
+	this->threshold = std::max(0.0f, threshold);
+	this->refresh = refresh;
+}
+
+void MotionGate::reset()
+{
+	complete = false;
+}
+
+// finds the changed blocks, copies them into the reference and builds the integral image of the changes
+void MotionGate::update_blocks(const uint8_t *pixels, int ldim, bool all)
+{
+	nchanged = 0;
+	for (int br = 0; br < nbrows; ++br)
+	{
+		const int r0 = br*MOTION_BLOCK_SIZE;
+		const int r1 = std::min(nrows, r0 + MOTION_BLOCK_SIZE);
+
+		for (int bc = 0; bc < nbcols; ++bc)
+		{
+			const int c0 = bc*MOTION_BLOCK_SIZE;
+			const int n = std::min(ncols, c0 + MOTION_BLOCK_SIZE) - c0;
+
+			bool changed = all;
+			if (!changed)
+			{
+				int sad = 0;
+				for (int r = r0; r < r1; ++r)
+					sad += get_row_sad(&pixels[(size_t)r*ldim + c0], &reference[(size_t)r*ncols + c0], n);
+				changed = sad > threshold*(r1 - r0)*n;
+			}
+
+			if (changed)
+			{
+				for (int r = r0; r < r1; ++r)
+					memcpy(&reference[(size_t)r*ncols + c0], &pixels[(size_t)r*ldim + c0], n);
+				++nchanged;
+			}
+
+			changes[(br+1)*(nbcols+1) + bc+1] = changed +
+				changes[br*(nbcols+1) + bc+1] + changes[(br+1)*(nbcols+1) + bc] - changes[br*(nbcols+1) + bc];
+		}
+	}
+}
+
+int MotionGate::detect(float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	int (*detection_func)(float*, int, int, int, const uint8_t*, int, int, int),
+	const uint8_t *pixels, int nrows, int ncols, int ldim,
+	float scalefactor, float stridefactor, float minsize, float maxsize)
+{
+	if (scalefactor != this->scalefactor || stridefactor != this->stridefactor ||
+		minsize != this->minsize || maxsize != this->maxsize)
+	{
+		this->scalefactor = scalefactor;
+		this->stridefactor = stridefactor;
+		this->minsize = minsize;
+		this->maxsize = maxsize;
+		complete = false;
+	}
+
+	if (nrows != this->nrows || ncols != this->ncols)
+	{
+		this->nrows = nrows;
+		this->ncols = ncols;
+		nbrows = (nrows + MOTION_BLOCK_SIZE-1)/MOTION_BLOCK_SIZE;
+		nbcols = (ncols + MOTION_BLOCK_SIZE-1)/MOTION_BLOCK_SIZE;
+
+		reference.resize((size_t)nrows*ncols);
+		changes.assign((nbrows+1)*(nbcols+1), 0);
+		complete = false;
+	}
+
+	// the results of the last frame can only be reused if they are all there
+	const bool all = !complete || (refresh > 0 && frame >= refresh);
+	update_blocks(pixels, ldim, all);
+	frame = all ? 1 : frame + 1;
+
+	// the detections of the last frame, in scan order
+	for (int k = 0; k < 4; ++k)
+		prev[k].swap(dets[k]);
+	size_t p = 0;
+
+	nclassified = 0;
+
+	int ndetections = 0;
+	for (float s = minsize; s <= maxsize && ndetections < maxndetections; s *= scalefactor)
+	{
+		float dr = std::max(stridefactor * s, 1.0f);
+		float dc = dr;
+
+		for (float r = s/2+1; r <= nrows-s/2-1 && ndetections < maxndetections; r += dr)
+		{
+			// blocks under the rows of the window
+			const int br0 = std::max(0, (int)(r - s/2) - 1)/MOTION_BLOCK_SIZE;
+			const int br1 = std::min(nrows-1, (int)(r + s/2) + 1)/MOTION_BLOCK_SIZE + 1;
+
+			for (float c = s/2+1; c <= ncols-s/2-1 && ndetections < maxndetections; c += dc)
+			{
+				const int bc0 = std::max(0, (int)(c - s/2) - 1)/MOTION_BLOCK_SIZE;
+				const int bc1 = std::min(ncols-1, (int)(c + s/2) + 1)/MOTION_BLOCK_SIZE + 1;
+				const int nchangedblocks = changes[br1*(nbcols+1) + bc1] - changes[br0*(nbcols+1) + bc1] -
+					changes[br1*(nbcols+1) + bc0] + changes[br0*(nbcols+1) + bc0];
+
+				// skip the last frame's detections of the windows before this one
+				while (p < prev[0].size() && (prev[2][p] < s || (prev[2][p] == s &&
+					(prev[0][p] < r || (prev[0][p] == r && prev[1][p] < c)))))
+					++p;
+				const bool detected = p < prev[0].size() && prev[2][p] == s && prev[0][p] == r && prev[1][p] == c;
+
+				float q;
+				if (nchangedblocks)
+				{
+					++nclassified;
+					if (detection_func(&q, r, c, s, pixels, nrows, ncols, ldim) != 1)
+						continue;
+				}
+				else if (detected)
+					q = prev[3][p];
+				else
+					continue;
+
+				qs[ndetections] = q;
+				rs[ndetections] = r;
+				cs[ndetections] = c;
+				ss[ndetections] = s;
+				++ndetections;
+			}
+		}
+	}
+
+	// the scan may have been cut short
+	complete = ndetections < maxndetections;
+
+	for (int k = 0; k < 4; ++k)
+		dets[k].resize(ndetections);
+	std::copy(rs, rs + ndetections, dets[0].begin());
+	std::copy(cs, cs + ndetections, dets[1].begin());
+	std::copy(ss, ss + ndetections, dets[2].begin());
+	std::copy(qs, qs + ndetections, dets[3].begin());
+
+	return ndetections;
+}
@@ -0,0 +1,129 @@
+#include "picornt.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__linux__)
+#define HAVE_HUGE_PAGES
+#include <sys/mman.h>
+#endif
+
+// rows start at multiples of this many bytes
+#define PADDED_ALIGNMENT 64
+// size of the huge pages requested from the system
+#define HUGE_PAGE_SIZE (2*1024*1024)
+
+PaddedImage::PaddedImage() :
+	data(0),
+	mem(0),
+	size(0),
+	capacity(0),
+	mapped(false),
+	hugepages(false),
+	rows(0), cols(0), stride(0)
+{}
+
+PaddedImage::~PaddedImage()
+{
+	release();
+}
+
+void PaddedImage::release()
+{
+#ifdef HAVE_HUGE_PAGES
+	if (mapped)
+		munmap(mem, size);
+	else
+#endif
+		free(mem);
+
+	data = 0;
+	mem = 0;
+	size = 0;
+	capacity = 0;
+	mapped = false;
+	hugepages = false;
+}
+
+bool PaddedImage::copy(const uint8_t *pixels, int nrows, int ncols, int ldim, bool usehugepages)
+{
+#ifndef HAVE_HUGE_PAGES
+	(void)usehugepages;
+#endif
+
+	// rows a multiple of 4096 bytes apart map to the same cache sets
+	int stride = (ncols + PADDED_ALIGNMENT-1)/PADDED_ALIGNMENT*PADDED_ALIGNMENT;
+	if (stride%4096 == 0)
+		stride += PADDED_ALIGNMENT;
+
+	// one more row of slack, so that vector loads past the last pixel stay in the buffer
+	const size_t nbytes = (size_t)(nrows + 1)*stride;
+
+	if (nbytes > capacity)
+	{
+		release();
+
+#ifdef HAVE_HUGE_PAGES
+		if (usehugepages)
+		{
+			const size_t length = (nbytes + HUGE_PAGE_SIZE-1)/HUGE_PAGE_SIZE*HUGE_PAGE_SIZE;
+
+#ifdef MAP_HUGETLB
+			// reserved huge pages, if the system has any
+			mem = mmap(0, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+			if (mem != MAP_FAILED)
+			{
+				data = (uint8_t*)mem;
+				size = capacity = length;
+				mapped = true;
+				hugepages = true;
+			}
+			else
+				mem = 0;
+#endif
+
+			// otherwise transparent huge pages, which need a 2 MiB aligned range
+			if (!mem)
+			{
+				const size_t total = length + HUGE_PAGE_SIZE;
+				mem = mmap(0, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+				if (mem == MAP_FAILED)
+				{
+					mem = 0;
+					return false;
+				}
+
+				data = (uint8_t*)mem + (HUGE_PAGE_SIZE - (uintptr_t)mem%HUGE_PAGE_SIZE)%HUGE_PAGE_SIZE;
+				size = total;
+				capacity = length;
+				mapped = true;
+#ifdef MADV_HUGEPAGE
+				hugepages = madvise(data, length, MADV_HUGEPAGE) == 0;
+#endif
+			}
+		}
+		else
+#endif
+		{
+			mem = malloc(nbytes + PADDED_ALIGNMENT);
+			if (!mem)
+				return false;
+
+			data = (uint8_t*)mem + (PADDED_ALIGNMENT - (uintptr_t)mem%PADDED_ALIGNMENT)%PADDED_ALIGNMENT;
+			size = capacity = nbytes;
+		}
+	}
+
+	for (int r = 0; r < nrows; ++r)
+	{
+		memcpy(&data[(size_t)r*stride], &pixels[(size_t)r*ldim], ncols);
+		memset(&data[(size_t)r*stride + ncols], 0, stride - ncols);
+	}
+	memset(&data[(size_t)nrows*stride], 0, stride);
+
+	rows = nrows;
+	cols = ncols;
+	this->stride = stride;
+
+	return true;
+}
@@ -22,10 +22,15 @@
 
 #include "picornt.h"
 #include "detect-cuda.h"
+#include "detect-simd.h"
+#include "find-objects.h"
 #include "cascades/face-cpu.h"
+#include "work-pool.h"
 
 #include <algorithm>
+#include <cmath>
 #include <cstring>
+#include <vector>
 
 int find_objects(
 	float *rs, float *cs, float *ss, float *qs, int maxndetections,
@@ -33,31 +38,1496 @@ int find_objects(
 	const uint8_t* pixels, int nrows, int ncols, int ldim,
 	float scalefactor, float stridefactor, float minsize, float maxsize)
 {
+	FunctionClassifier classifier(detection_func);
+
+	return find_objects(rs, cs, ss, qs, maxndetections, classifier,
+		pixels, nrows, ncols, ldim, scalefactor, stridefactor, minsize, maxsize);
+}
+
+// classifies n windows of row r, starting at column *c, with the interior or the checked function
+template <bool interior>
+static inline int scan_span(float *rs, float *cs, float *ss, float *qs, int ndetections, int maxndetections,
+	int (*detection_func)(float*, int, int, int, const uint8_t*, int, int, int),
+	int (*interior_func)(float*, int, int, int, const uint8_t*, int),
+	float r, float *c, int n, float dc, float s,
+	const uint8_t *pixels, int nrows, int ncols, int ldim)
+{
+	for (int j = 0; j < n; ++j, *c += dc)
+	{
+		if (ndetections >= maxndetections)
+			break;
+
+		float q;
+		int result = interior ?
+			interior_func(&q, r, *c, s, pixels, ldim) :
+			detection_func(&q, r, *c, s, pixels, nrows, ncols, ldim);
+		if (result != 1)
+			continue;
+
+		qs[ndetections] = q;
+		rs[ndetections] = r;
+		cs[ndetections] = *c;
+		ss[ndetections] = s;
+		++ndetections;
+	}
+
+	return ndetections;
+}
+
+int find_objects(
+	float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	int (*detection_func)(float*, int, int, int, const uint8_t*, int, int, int),
+	int (*interior_func)(float*, int, int, int, const uint8_t*, int),
+	const CascadeTables &cascade,
+	const uint8_t *pixels, int nrows, int ncols, int ldim,
+	float scalefactor, float stridefactor, float minsize, float maxsize)
+{
+	int ndetections = 0;
+	for (float s = minsize; s <= maxsize; s *= scalefactor)
+	{
+		float dr = std::max(stridefactor * s, 1.0f);
+		float dc = dr;
+
+		// window centres (in pixels) which pass the bounds test of detection_func:
+		// (256*r - maxr*sr)/256 >= 0 and (256*r + maxr*sr)/256 < nrows, same for columns
+		int sr = (int)(cascade.tsr*(int)s);
+		int sc = (int)(cascade.tsc*(int)s);
+		int rmin = cascade.maxr*sr/256;
+		int rmax = nrows - 1 - rmin;
+		int cmin = cascade.maxc*sc/256;
+		int cmax = ncols - 1 - cmin;
+
+		// split the columns (the same for every row) into left border, interior and right border
+		int nleft = 0, ninterior = 0, nright = 0;
+		for (float c = s/2+1; c <= ncols-s/2-1; c += dc)
+		{
+			if ((int)c < cmin)
+				++nleft;
+			else if ((int)c <= cmax)
+				++ninterior;
+			else
+				++nright;
+		}
+
+		for (float r = s/2+1; r <= nrows-s/2-1; r += dr)
+		{
+			float c = s/2+1;
+			if ((int)r < rmin || (int)r > rmax)
+			{
+				ndetections = scan_span<false>(rs, cs, ss, qs, ndetections, maxndetections, detection_func, interior_func,
+					r, &c, nleft+ninterior+nright, dc, s, pixels, nrows, ncols, ldim);
+				continue;
+			}
+
+			ndetections = scan_span<false>(rs, cs, ss, qs, ndetections, maxndetections, detection_func, interior_func,
+				r, &c, nleft, dc, s, pixels, nrows, ncols, ldim);
+			ndetections = scan_span<true>(rs, cs, ss, qs, ndetections, maxndetections, detection_func, interior_func,
+				r, &c, ninterior, dc, s, pixels, nrows, ncols, ldim);
+			ndetections = scan_span<false>(rs, cs, ss, qs, ndetections, maxndetections, detection_func, interior_func,
+				r, &c, nright, dc, s, pixels, nrows, ncols, ldim);
+		}
+	}
+
+	return ndetections;
+}
+
+/*
+	The evaluators below are templates on the tree depth D, so that the node loop
+	is fully unrolled for the common depths (4 to 8), as in the code picogen generates.
+	D = 0 stands for "read the depth from the cascade".
+*/
+
+#define CALL_FOR_TDEPTH(tdepth, func, ...) \
+	switch (tdepth) \
+	{ \
+		case 4: return func<4>(__VA_ARGS__); \
+		case 5: return func<5>(__VA_ARGS__); \
+		case 6: return func<6>(__VA_ARGS__); \
+		case 7: return func<7>(__VA_ARGS__); \
+		case 8: return func<8>(__VA_ARGS__); \
+		default: return func<0>(__VA_ARGS__); \
+	}
+
+static inline bool window_inside(const CascadeTables &cascade, int r, int c, int sr, int sc,
+	int nrows, int ncols)
+{
+	return (r+cascade.maxr*sr)/256<nrows && (r-cascade.maxr*sr)/256>=0 &&
+		(c+cascade.maxc*sc)/256<ncols && (c-cascade.maxc*sc)/256>=0;
+}
+
+template <int D>
+static int classify_window(const CascadeTables &cascade, float *o, int r, int c, int sr, int sc,
+	const uint8_t *pixels, int ldim)
+{
+	*o = 0.0f;
+	for (int i = 0; i < cascade.ntrees; ++i)
+	{
+		*o += get_tree_output<D>(cascade, i, r, c, sr, sc, pixels, ldim);
+
+		if (*o <= cascade.thresholds[i])
+			return -1;
+	}
+
+	*o -= cascade.thresholds[cascade.ntrees-1];
+
+	return 1;
+}
+
+int classify_window(const CascadeTables &cascade, float *o, int r, int c, int s,
+	const uint8_t *pixels, int nrows, int ncols, int ldim)
+{
+	int sr = (int)(cascade.tsr*s);
+	int sc = (int)(cascade.tsc*s);
+
+	r *= 256;
+	c *= 256;
+
+	if (!window_inside(cascade, r, c, sr, sc, nrows, ncols))
+		return -1;
+
+	CALL_FOR_TDEPTH(cascade.tdepth, classify_window, cascade, o, r, c, sr, sc, pixels, ldim);
+}
+
+// window centres along one image axis, accumulated exactly as in find_objects
+static void get_scan_positions(std::vector<float> &ps, float s, float step, int n)
+{
+	ps.clear();
+	for (float p = s/2+1; p <= n-s/2-1; p += step)
+		ps.push_back(p);
+}
+
+int find_objects(
+	float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	const CascadeTables &cascade,
+	const uint8_t* pixels, int nrows, int ncols, int ldim,
+	float scalefactor, float stridefactor, float minsize, float maxsize)
+{
+	batch_classifier classify = get_batch_classifier();
+
+	std::vector<float> cols;
+	std::vector<int> icols;
+	std::vector<int> hits;
+	std::vector<float> os;
+
+	int ndetections = 0;
+	for (float s = minsize; s <= maxsize; s *= scalefactor)
+	{
+		float dr = std::max(stridefactor * s, 1.0f);
+		float dc = dr;
+
+		// the same columns are scanned in every row
+		get_scan_positions(cols, s, dc, ncols);
+		int n = cols.size();
+		if (!n)
+			continue;
+		icols.assign(cols.begin(), cols.end());
+		hits.resize(n);
+		os.resize(n);
+
+		for (float r = s/2+1; r <= nrows-s/2-1; r += dr)
+		{
+			if (ndetections >= maxndetections)
+				return ndetections;
+
+			classify(cascade, &hits[0], &os[0], r, &icols[0], n, s, pixels, nrows, ncols, ldim);
+
+			for (int k = 0; k < n && ndetections < maxndetections; ++k)
+			{
+				if (hits[k] != 1)
+					continue;
+
+				qs[ndetections] = os[k];
+				rs[ndetections] = r;
+				cs[ndetections] = cols[k];
+				ss[ndetections] = s;
+				++ndetections;
+			}
+		}
+	}
+	return ndetections;
+}
+
+template <int D>
+static int find_objects_bfs(
+	float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	const CascadeTables &cascade,
+	const uint8_t* pixels, int nrows, int ncols, int ldim,
+	float scalefactor, float stridefactor, float minsize, float maxsize,
+	int treeblock)
+{
+	std::vector<float> rows;
+	std::vector<float> cols;
+
+	// windows still alive at the current scale, kept in the scan order
+	std::vector<int> wrs;  // centre row, times 256
+	std::vector<int> wcs;  // centre column, times 256
+	std::vector<int> wps;  // position in the scan, row*cols.size() + column
+	std::vector<float> wos;  // accumulated output
+
+	int ndetections = 0;
+	for (float s = minsize; s <= maxsize && ndetections < maxndetections; s *= scalefactor)
+	{
+		float dr = std::max(stridefactor * s, 1.0f);
+		float dc = dr;
+
+		get_scan_positions(rows, s, dr, nrows);
+		get_scan_positions(cols, s, dc, ncols);
+
+		int sr = (int)(cascade.tsr*(int)s);
+		int sc = (int)(cascade.tsc*(int)s);
+
+		// the first block of trees is run while enumerating the windows,
+		// most of them are rejected right there and never stored
+		int t1 = std::min(cascade.ntrees, treeblock);
+
+		wrs.clear();
+		wcs.clear();
+		wps.clear();
+		wos.clear();
+		for (size_t i = 0; i < rows.size(); ++i)
+		{
+			int r = 256*(int)rows[i];
+			for (size_t j = 0; j < cols.size(); ++j)
+			{
+				int c = 256*(int)cols[j];
+				if (!window_inside(cascade, r, c, sr, sc, nrows, ncols))
+					continue;
+
+				float o = 0.0f;
+				int t = 0;
+				for (; t < t1; ++t)
+				{
+					o += get_tree_output<D>(cascade, t, r, c, sr, sc, pixels, ldim);
+					if (o <= cascade.thresholds[t])
+						break;
+				}
+
+				if (t < t1)
+					continue;
+
+				wrs.push_back(r);
+				wcs.push_back(c);
+				wps.push_back(i*cols.size() + j);
+				wos.push_back(o);
+			}
+		}
+		int n = wrs.size();
+
+		// then every further block of trees is run over all survivors, which are compacted,
+		// so that only the tables of these few trees are touched during the pass
+		for (int t0 = t1; t0 < cascade.ntrees && n; t0 += treeblock)
+		{
+			t1 = std::min(cascade.ntrees, t0 + treeblock);
+
+			int m = 0;
+			for (int k = 0; k < n; ++k)
+			{
+				int r = wrs[k];
+				int c = wcs[k];
+				float o = wos[k];
+
+				int t = t0;
+				for (; t < t1; ++t)
+				{
+					o += get_tree_output<D>(cascade, t, r, c, sr, sc, pixels, ldim);
+					if (o <= cascade.thresholds[t])
+						break;
+				}
+
+				if (t < t1)
+					continue;
+
+				wrs[m] = r;
+				wcs[m] = c;
+				wps[m] = wps[k];
+				wos[m] = o;
+				++m;
+			}
+			n = m;
+		}
+
+		for (int k = 0; k < n && ndetections < maxndetections; ++k)
+		{
+			qs[ndetections] = wos[k] - cascade.thresholds[cascade.ntrees-1];
+			rs[ndetections] = rows[wps[k] / cols.size()];
+			cs[ndetections] = cols[wps[k] % cols.size()];
+			ss[ndetections] = s;
+			++ndetections;
+		}
+	}
+
+	return ndetections;
+}
+
+int find_objects_bfs(
+	float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	const CascadeTables &cascade,
+	const uint8_t* pixels, int nrows, int ncols, int ldim,
+	float scalefactor, float stridefactor, float minsize, float maxsize,
+	int treeblock)
+{
+	CALL_FOR_TDEPTH(cascade.tdepth, find_objects_bfs,
+		rs, cs, ss, qs, maxndetections, cascade, pixels, nrows, ncols, ldim,
+		scalefactor, stridefactor, minsize, maxsize, std::max(1, treeblock));
+}
+
+// x/256 rounded down
+static inline int floor_div256(int x)
+{
+	return x >= 0 ? x/256 : -((255-x)/256);
+}
+
+ScanPlan::ScanPlan() :
+	cascade(0),
+	generation(0),
+	nrows(0),
+	ncols(0),
+	ldim(0),
+	scalefactor(0.0f),
+	stridefactor(0.0f),
+	minsize(0.0f),
+	maxsize(0.0f),
+	tiled(false)
+{}
+
+bool ScanPlan::prepare(const CascadeTables &cascade, int nrows, int ncols, int ldim,
+	float scalefactor, float stridefactor, float minsize, float maxsize, bool tiled)
+{
+	// the tables of a RuntimeCascade stay at the same address when a new model is loaded
+	if (this->cascade == &cascade && this->generation == cascade.generation &&
+		this->nrows == nrows && this->ncols == ncols &&
+		this->ldim == ldim && this->scalefactor == scalefactor &&
+		this->stridefactor == stridefactor && this->minsize == minsize && this->maxsize == maxsize &&
+		this->tiled == tiled)
+		return false;
+
+	this->cascade = &cascade;
+	this->generation = cascade.generation;
+	this->nrows = nrows;
+	this->ncols = ncols;
+	this->ldim = ldim;
+	this->scalefactor = scalefactor;
+	this->stridefactor = stridefactor;
+	this->minsize = minsize;
+	this->maxsize = maxsize;
+	this->tiled = tiled;
+
+	const int ntests = cascade.ntrees << cascade.tdepth;
+
+	scales.clear();
+	for (float s = minsize; s <= maxsize; s *= scalefactor)
+	{
+		float dr = std::max(stridefactor * s, 1.0f);
+		float dc = dr;
+
+		scales.push_back(ScanScale());
+		ScanScale &scale = scales.back();
+
+		scale.s = s;
+		scale.sr = (int)(cascade.tsr*(int)s);
+		scale.sc = (int)(cascade.tsc*(int)s);
+		get_scan_positions(scale.rows, s, dr, nrows);
+		get_scan_positions(scale.cols, s, dc, ncols);
+
+		// (r + t*sr)/256 == r/256 + floor(t*sr/256) as long as r + t*sr >= 0,
+		// which find_objects makes sure of before it uses these
+		scale.offsets.resize(2*ntests);
+		for (int i = 0; i < ntests; ++i)
+		{
+			const int16_t *t = cascade.tcodes[i];
+			scale.offsets[2*i+0] = floor_div256(t[0]*scale.sr)*ldim + floor_div256(t[1]*scale.sc);
+			scale.offsets[2*i+1] = floor_div256(t[2]*scale.sr)*ldim + floor_div256(t[3]*scale.sc);
+		}
+
+		if (!tiled)
+			continue;
+
+		scale.deltas.resize(4*ntests);
+		for (int i = 0; i < ntests; ++i)
+			for (int j = 0; j < 4; ++j)
+				scale.deltas[4*i+j] = floor_div256(cascade.tcodes[i][j]*(j%2 ? scale.sc : scale.sr));
+	}
+
+	return true;
+}
+
+// classify_window for a window whose pixel pairs are given by offsets from the centre pixel p
+template <int D>
+static inline int classify_window(const CascadeTables &cascade, const int32_t *offsets,
+	float *o, const uint8_t *p)
+{
+	const int tdepth = D ? D : cascade.tdepth;
+	const int nnodes = 1<<tdepth;
+
+	*o = 0.0f;
+	for (int i = 0; i < cascade.ntrees; ++i)
+	{
+		const int32_t *off = &offsets[2*i*nnodes];
+
+		int idx = 1;
+		for (int j = 0; j < tdepth; ++j)
+			idx = 2*idx + (p[off[2*idx]] <= p[off[2*idx+1]]);
+
+		*o += cascade.luts[i*nnodes + idx - nnodes];
+
+		if (*o <= cascade.thresholds[i])
+			return -1;
+	}
+
+	*o -= cascade.thresholds[cascade.ntrees-1];
+
+	return 1;
+}
+
+// scans the windows [i0, i1) x [j0, j1) of one scale of a plan, returns the new amount of detections
+template <int D>
+static int scan_scale(
+	float *rs, float *cs, float *ss, float *qs, int ndetections, int maxndetections,
+	const ScanPlan &plan, const ScanScale &scale, const CascadeJit *jit, const uint8_t *pixels,
+	size_t i0, size_t i1, size_t j0, size_t j1)
+{
+	const CascadeTables &cascade = *plan.cascade;
+
+	for (size_t i = i0; i < i1; ++i)
+	{
+		int r = 256*(int)scale.rows[i];
+		for (size_t j = j0; j < j1; ++j)
+		{
+			if (ndetections >= maxndetections)
+				return ndetections;
+
+			int c = 256*(int)scale.cols[j];
+			if (!window_inside(cascade, r, c, scale.sr, scale.sc, plan.nrows, plan.ncols))
+				continue;
+
+			float q;
+			int result;
+			if (r-cascade.maxr*scale.sr >= 0 && c-cascade.maxc*scale.sc >= 0)
+			{
+				const uint8_t *p = &pixels[r/256*plan.ldim + c/256];
+				if (jit)
+					result = jit->classify(&q, p, &scale.offsets[0]);
+				else
+					result = classify_window<D>(cascade, &scale.offsets[0], &q, p);
+			}
+			else
+				result = classify_window<D>(cascade, &q, r, c, scale.sr, scale.sc, pixels, plan.ldim);
+
+			if (result != 1)
+				continue;
+
+			qs[ndetections] = q;
+			rs[ndetections] = scale.rows[i];
+			cs[ndetections] = scale.cols[j];
+			ss[ndetections] = scale.s;
+			++ndetections;
+		}
+	}
+
+	return ndetections;
+}
+
+template <int D>
+static int find_objects(
+	float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	const ScanPlan &plan, const CascadeJit *jit, const uint8_t *pixels)
+{
+	int ndetections = 0;
+	for (size_t k = 0; k < plan.scales.size(); ++k)
+	{
+		const ScanScale &scale = plan.scales[k];
+
+		ndetections = scan_scale<D>(rs, cs, ss, qs, ndetections, maxndetections, plan, scale, jit, pixels,
+			0, scale.rows.size(), 0, scale.cols.size());
+	}
+
+	return ndetections;
+}
+
+int find_objects(
+	float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	const ScanPlan &plan, const uint8_t *pixels)
+{
+	CALL_FOR_TDEPTH(plan.cascade->tdepth, find_objects, rs, cs, ss, qs, maxndetections, plan, (const CascadeJit*)0, pixels);
+}
+
+int find_objects(
+	float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	const ScanPlan &plan, const CascadeJit &jit, const uint8_t *pixels)
+{
+	// fall back to the table evaluator if the cascade could not be compiled,
+	// or if the code is of other tables than the plan (a reloaded RuntimeCascade included)
+	const CascadeJit *p = jit.ready() && jit.tables() == plan.cascade && jit.generation() == plan.generation ? &jit : 0;
+
+	CALL_FOR_TDEPTH(plan.cascade->tdepth, find_objects, rs, cs, ss, qs, maxndetections, plan, p, pixels);
+}
+
+// positions [first, last) of the window centres in [lo, hi)
+static inline void get_position_range(const std::vector<float> &ps, float lo, float hi, size_t *first, size_t *last)
+{
+	*first = std::lower_bound(ps.begin(), ps.end(), lo) - ps.begin();
+	*last = std::lower_bound(ps.begin(), ps.end(), hi) - ps.begin();
+}
+
+template <int D>
+static int find_objects_tiled(
+	float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	const ScanPlan &plan, const uint8_t *pixels, int tilesize)
+{
+	// the scales whose windows (with the binary tests, at most maxr*sr/256 pixels from the centre)
+	// fit in a tile are scanned tile by tile, all of them before moving on to the next tile;
+	// the sizes increase, so these are the first nsmall scales
+	size_t nsmall = 0;
+	while (nsmall < plan.scales.size())
+	{
+		const ScanScale &scale = plan.scales[nsmall];
+		const int halo = std::max(plan.cascade->maxr*scale.sr, plan.cascade->maxc*scale.sc)/256 + 1;
+		if (2*halo > tilesize)
+			break;
+		++nsmall;
+	}
+
+	int ndetections = 0;
+	for (int tr = 0; tr < plan.nrows; tr += tilesize)
+		for (int tc = 0; tc < plan.ncols; tc += tilesize)
+			for (size_t k = 0; k < nsmall; ++k)
+			{
+				const ScanScale &scale = plan.scales[k];
+
+				size_t i0, i1, j0, j1;
+				get_position_range(scale.rows, tr, tr + tilesize, &i0, &i1);
+				get_position_range(scale.cols, tc, tc + tilesize, &j0, &j1);
+
+				ndetections = scan_scale<D>(rs, cs, ss, qs, ndetections, maxndetections, plan, scale, 0, pixels,
+					i0, i1, j0, j1);
+			}
+
+	for (size_t k = nsmall; k < plan.scales.size(); ++k)
+	{
+		const ScanScale &scale = plan.scales[k];
+
+		ndetections = scan_scale<D>(rs, cs, ss, qs, ndetections, maxndetections, plan, scale, 0, pixels,
+			0, scale.rows.size(), 0, scale.cols.size());
+	}
+
+	return ndetections;
+}
+
+int find_objects_tiled(
+	float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	const ScanPlan &plan, const uint8_t *pixels, int tilesize)
+{
+	if (tilesize <= 0)
+		tilesize = DEFAULT_TILE_SIZE;
+
+	CALL_FOR_TDEPTH(plan.cascade->tdepth, find_objects_tiled, rs, cs, ss, qs, maxndetections, plan, pixels, tilesize);
+}
+
+template <int D>
+static int find_objects(
+	float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	const ScanPlan &plan, const ScalePrior &prior, const uint8_t *pixels)
+{
+	int ndetections = 0;
+	for (size_t k = 0; k < plan.scales.size(); ++k)
+	{
+		const ScanScale &scale = plan.scales[k];
+
+		// the runs of rows the prior allows at this scale
+		size_t i0 = 0;
+		while (i0 < scale.rows.size())
+		{
+			if (!prior.allows(scale.rows[i0], scale.s))
+			{
+				++i0;
+				continue;
+			}
+
+			size_t i1 = i0 + 1;
+			while (i1 < scale.rows.size() && prior.allows(scale.rows[i1], scale.s))
+				++i1;
+
+			ndetections = scan_scale<D>(rs, cs, ss, qs, ndetections, maxndetections, plan, scale, 0, pixels,
+				i0, i1, 0, scale.cols.size());
+			i0 = i1;
+		}
+	}
+
+	return ndetections;
+}
+
+int find_objects(
+	float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	const ScanPlan &plan, const ScalePrior &prior, const uint8_t *pixels)
+{
+	CALL_FOR_TDEPTH(plan.cascade->tdepth, find_objects, rs, cs, ss, qs, maxndetections, plan, prior, pixels);
+}
+
+template <int D>
+static int find_objects_coarse_to_fine(
+	float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	const ScanPlan &plan, const uint8_t *pixels,
+	float coarsestridefactor, int ntrees, float slack)
+{
+	// the first ntrees trees, with lower thresholds, make up the cascade of the first pass
+	std::vector<float> thresholds(plan.cascade->thresholds, plan.cascade->thresholds + ntrees);
+	for (int i = 0; i < ntrees; ++i)
+		thresholds[i] -= slack;
+
+	CascadeTables coarse = *plan.cascade;
+	coarse.ntrees = ntrees;
+	coarse.thresholds = &thresholds[0];
+
+	std::vector<float> rows, cols;
+	std::vector<uint8_t> marks;
+
+	int ndetections = 0;
+	for (size_t k = 0; k < plan.scales.size() && ndetections < maxndetections; ++k)
+	{
+		const ScanScale &scale = plan.scales[k];
+		const size_t nr = scale.rows.size();
+		const size_t nc = scale.cols.size();
+
+		const float d = std::max(coarsestridefactor * scale.s, 1.0f);
+		get_scan_positions(rows, scale.s, d, plan.nrows);
+		get_scan_positions(cols, scale.s, d, plan.ncols);
+
+		// the windows of the plan around the coarse windows that pass
+		marks.assign(nr*nc, 0);
+		for (size_t i = 0; i < rows.size(); ++i)
+		{
+			const int r = 256*(int)rows[i];
+
+			size_t i0, i1;
+			get_position_range(scale.rows, rows[i] - d, rows[i] + d, &i0, &i1);
+
+			for (size_t j = 0; j < cols.size(); ++j)
+			{
+				const int c = 256*(int)cols[j];
+
+				// near the border the first pass is skipped, the second one checks the windows anyway
+				float q;
+				if (window_inside(coarse, r, c, scale.sr, scale.sc, plan.nrows, plan.ncols) &&
+					r-coarse.maxr*scale.sr >= 0 && c-coarse.maxc*scale.sc >= 0 &&
+					classify_window<D>(coarse, &scale.offsets[0], &q, &pixels[r/256*plan.ldim + c/256]) != 1)
+					continue;
+
+				size_t j0, j1;
+				get_position_range(scale.cols, cols[j] - d, cols[j] + d, &j0, &j1);
+
+				for (size_t a = i0; a < i1; ++a)
+					memset(&marks[a*nc + j0], 1, j1 - j0);
+			}
+		}
+
+		// the marked runs of every row, in the order of the plan
+		for (size_t i = 0; i < nr; ++i)
+			for (size_t j0 = 0; j0 < nc; )
+			{
+				if (!marks[i*nc + j0])
+				{
+					++j0;
+					continue;
+				}
+
+				size_t j1 = j0 + 1;
+				while (j1 < nc && marks[i*nc + j1])
+					++j1;
+
+				ndetections = scan_scale<D>(rs, cs, ss, qs, ndetections, maxndetections, plan, scale, 0, pixels,
+					i, i+1, j0, j1);
+				j0 = j1;
+			}
+	}
+
+	return ndetections;
+}
+
+int find_objects_coarse_to_fine(
+	float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	const ScanPlan &plan, const uint8_t *pixels,
+	float coarsestridefactor, int ntrees, float slack)
+{
+	ntrees = std::min(std::max(1, ntrees), plan.cascade->ntrees);
+
+	CALL_FOR_TDEPTH(plan.cascade->tdepth, find_objects_coarse_to_fine, rs, cs, ss, qs, maxndetections, plan, pixels,
+		coarsestridefactor, ntrees, slack);
+}
+
+// same as classify_window with offsets, also returning the index of the tree that rejected the window
+template <int D>
+static inline int classify_window(const CascadeTables &cascade, const int32_t *offsets,
+	float *o, const uint8_t *p, int *depth)
+{
+	const int tdepth = D ? D : cascade.tdepth;
+	const int nnodes = 1<<tdepth;
+
+	*o = 0.0f;
+	for (int i = 0; i < cascade.ntrees; ++i)
+	{
+		const int32_t *off = &offsets[2*i*nnodes];
+
+		int idx = 1;
+		for (int j = 0; j < tdepth; ++j)
+			idx = 2*idx + (p[off[2*idx]] <= p[off[2*idx+1]]);
+
+		*o += cascade.luts[i*nnodes + idx - nnodes];
+
+		if (*o <= cascade.thresholds[i])
+		{
+			*depth = i;
+			return -1;
+		}
+	}
+
+	*o -= cascade.thresholds[cascade.ntrees-1];
+	*depth = cascade.ntrees;
+
+	return 1;
+}
+
+template <int D>
+static int find_objects_adaptive(
+	float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	const ScanPlan &plan, const uint8_t *pixels,
+	const int *skips, int nskips)
+{
+	const CascadeTables &cascade = *plan.cascade;
+
+	int ndetections = 0;
+	for (size_t k = 0; k < plan.scales.size(); ++k)
+	{
+		const ScanScale &scale = plan.scales[k];
+
+		for (size_t i = 0; i < scale.rows.size(); ++i)
+		{
+			int r = 256*(int)scale.rows[i];
+			for (size_t j = 0; j < scale.cols.size(); ++j)
+			{
+				if (ndetections >= maxndetections)
+					return ndetections;
+
+				int c = 256*(int)scale.cols[j];
+				if (!window_inside(cascade, r, c, scale.sr, scale.sc, plan.nrows, plan.ncols))
+					continue;
+
+				// the windows near the border are all classified
+				float q;
+				int result;
+				if (r-cascade.maxr*scale.sr >= 0 && c-cascade.maxc*scale.sc >= 0)
+				{
+					int depth;
+					result = classify_window<D>(cascade, &scale.offsets[0], &q, &pixels[r/256*plan.ldim + c/256], &depth);
+					if (result != 1 && depth < nskips)
+						j += std::max(0, skips[depth]);
+				}
+				else
+					result = classify_window<D>(cascade, &q, r, c, scale.sr, scale.sc, pixels, plan.ldim);
+
+				if (result != 1)
+					continue;
+
+				qs[ndetections] = q;
+				rs[ndetections] = scale.rows[i];
+				cs[ndetections] = scale.cols[j];
+				ss[ndetections] = scale.s;
+				++ndetections;
+			}
+		}
+	}
+
+	return ndetections;
+}
+
+int find_objects_adaptive(
+	float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	const ScanPlan &plan, const uint8_t *pixels,
+	const int *skips, int nskips)
+{
+	CALL_FOR_TDEPTH(plan.cascade->tdepth, find_objects_adaptive, rs, cs, ss, qs, maxndetections, plan, pixels,
+		skips, std::max(0, nskips));
+}
+
+// the rest of classify_window with offsets, for a window that has passed the first trees with output *o
+template <int D>
+static inline int resume_window(const CascadeTables &cascade, const int32_t *offsets,
+	float *o, const uint8_t *p, int first)
+{
+	const int tdepth = D ? D : cascade.tdepth;
+	const int nnodes = 1<<tdepth;
+
+	for (int i = first; i < cascade.ntrees; ++i)
+	{
+		const int32_t *off = &offsets[2*i*nnodes];
+
+		int idx = 1;
+		for (int j = 0; j < tdepth; ++j)
+			idx = 2*idx + (p[off[2*idx]] <= p[off[2*idx+1]]);
+
+		*o += cascade.luts[i*nnodes + idx - nnodes];
+
+		if (*o <= cascade.thresholds[i])
+			return -1;
+	}
+
+	*o -= cascade.thresholds[cascade.ntrees-1];
+
+	return 1;
+}
+
+template <int D>
+static int find_objects_dense(
+	float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	const ScanPlan &plan, const uint8_t *pixels, int ntrees)
+{
+	const CascadeTables &cascade = *plan.cascade;
+	const int nnodes = 1<<cascade.tdepth;
+
+	static const dense_tree_evaluator evaluate_trees = get_dense_tree_evaluator();
+	std::vector<uint8_t> leaves;
+
+	int ndetections = 0;
+	for (size_t k = 0; k < plan.scales.size(); ++k)
+	{
+		const ScanScale &scale = plan.scales[k];
+
+		if (std::max(plan.stridefactor*scale.s, 1.0f) > DENSE_MAX_STRIDE)
+		{
+			ndetections = scan_scale<D>(rs, cs, ss, qs, ndetections, maxndetections, plan, scale, 0, pixels,
+				0, scale.rows.size(), 0, scale.cols.size());
+			continue;
+		}
+
+		// the columns [j0, j1) whose windows can use the offsets (the same in every row)
+		size_t j0 = 0;
+		while (j0 < scale.cols.size() && 256*(int)scale.cols[j0]-cascade.maxc*scale.sc < 0)
+			++j0;
+		size_t j1 = j0;
+		while (j1 < scale.cols.size() && (256*(int)scale.cols[j1]+cascade.maxc*scale.sc)/256 < plan.ncols)
+			++j1;
+
+		if (j0 == j1)
+		{
+			ndetections = scan_scale<D>(rs, cs, ss, qs, ndetections, maxndetections, plan, scale, 0, pixels,
+				0, scale.rows.size(), 0, scale.cols.size());
+			continue;
+		}
+
+		// the pixels of a row from the first to the last of these window centres
+		const int c0 = (int)scale.cols[j0];
+		const int n = (int)scale.cols[j1-1] - c0 + 1;
+		leaves.resize((size_t)ntrees*n);
+
+		for (size_t i = 0; i < scale.rows.size(); ++i)
+		{
+			const int r = 256*(int)scale.rows[i];
+			if (r-cascade.maxr*scale.sr < 0 || (r+cascade.maxr*scale.sr)/256 >= plan.nrows)
+			{
+				ndetections = scan_scale<D>(rs, cs, ss, qs, ndetections, maxndetections, plan, scale, 0, pixels,
+					i, i+1, 0, scale.cols.size());
+				continue;
+			}
+
+			ndetections = scan_scale<D>(rs, cs, ss, qs, ndetections, maxndetections, plan, scale, 0, pixels,
+				i, i+1, 0, j0);
+
+			const uint8_t *p = &pixels[r/256*plan.ldim + c0];
+			evaluate_trees(cascade, ntrees, &scale.offsets[0], p, n, &leaves[0]);
+
+			for (size_t j = j0; j < j1; ++j)
+			{
+				if (ndetections >= maxndetections)
+					return ndetections;
+
+				const int c = (int)scale.cols[j] - c0;
+
+				float q = 0.0f;
+				int t = 0;
+				for (; t < ntrees; ++t)
+				{
+					q += cascade.luts[t*nnodes + leaves[t*n + c]];
+					if (q <= cascade.thresholds[t])
+						break;
+				}
+				if (t < ntrees)
+					continue;
+
+				if (resume_window<D>(cascade, &scale.offsets[0], &q, &p[c], ntrees) != 1)
+					continue;
+
+				qs[ndetections] = q;
+				rs[ndetections] = scale.rows[i];
+				cs[ndetections] = scale.cols[j];
+				ss[ndetections] = scale.s;
+				++ndetections;
+			}
+
+			ndetections = scan_scale<D>(rs, cs, ss, qs, ndetections, maxndetections, plan, scale, 0, pixels,
+				i, i+1, j1, scale.cols.size());
+		}
+	}
+
+	return ndetections;
+}
+
+int find_objects_dense(
+	float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	const ScanPlan &plan, const uint8_t *pixels, int ntrees)
+{
+	ntrees = std::min(std::max(1, ntrees), plan.cascade->ntrees);
+	if (plan.cascade->tdepth > 8)
+		return find_objects(rs, cs, ss, qs, maxndetections, plan, pixels);
+
+	CALL_FOR_TDEPTH(plan.cascade->tdepth, find_objects_dense, rs, cs, ss, qs, maxndetections, plan, pixels, ntrees);
+}
+
+#ifdef __GNUC__
+#define PREFETCH(p) __builtin_prefetch(p)
+#else
+#define PREFETCH(p)
+#endif
+
+// windows of one row evaluated together by find_objects_interleaved
+struct InterleavedWindows
+{
+	int win[MAX_INTERLEAVED_WINDOWS];  // window (column) index, -1 for an idle lane
+	int tree[MAX_INTERLEAVED_WINDOWS];
+	int idx[MAX_INTERLEAVED_WINDOWS];  // node within the tree
+	float o[MAX_INTERLEAVED_WINDOWS];
+	const uint8_t *p[MAX_INTERLEAVED_WINDOWS];  // centre pixel
+};
+
+template <int D>
+static int find_objects_interleaved(
+	float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	const ScanPlan &plan, const uint8_t *pixels, int nwindows)
+{
+	const CascadeTables &cascade = *plan.cascade;
+	const int tdepth = D ? D : cascade.tdepth;
+	const int nnodes = 1<<tdepth;
+
+	InterleavedWindows lanes;
+	std::vector<float> outputs;
+	std::vector<uint8_t> passed;
+
+	int ndetections = 0;
+	for (size_t k = 0; k < plan.scales.size(); ++k)
+	{
+		const ScanScale &scale = plan.scales[k];
+		const int32_t *offsets = &scale.offsets[0];
+
+		// the columns [j0, j1) whose windows can use the offsets (the same in every row)
+		size_t j0 = 0;
+		while (j0 < scale.cols.size() && 256*(int)scale.cols[j0]-cascade.maxc*scale.sc < 0)
+			++j0;
+		size_t j1 = j0;
+		while (j1 < scale.cols.size() && (256*(int)scale.cols[j1]+cascade.maxc*scale.sc)/256 < plan.ncols)
+			++j1;
+
+		outputs.resize(scale.cols.size());
+		passed.resize(scale.cols.size());
+
+		for (size_t i = 0; i < scale.rows.size(); ++i)
+		{
+			const int r = 256*(int)scale.rows[i];
+			if (j0 == j1 || r-cascade.maxr*scale.sr < 0 || (r+cascade.maxr*scale.sr)/256 >= plan.nrows)
+			{
+				ndetections = scan_scale<D>(rs, cs, ss, qs, ndetections, maxndetections, plan, scale, 0, pixels,
+					i, i+1, 0, scale.cols.size());
+				continue;
+			}
+
+			ndetections = scan_scale<D>(rs, cs, ss, qs, ndetections, maxndetections, plan, scale, 0, pixels,
+				i, i+1, 0, j0);
+			if (ndetections >= maxndetections)
+				return ndetections;
+
+			const uint8_t *row = &pixels[r/256*plan.ldim];
+
+			// every lane steps through one node at a time and takes the next window of the row when its own is done;
+			// the windows finish out of order, so their results are kept until the row is done
+			size_t next = j0;
+			int nactive = 0;
+			for (int l = 0; l < nwindows; ++l)
+			{
+				lanes.win[l] = -1;
+				if (next == j1)
+					continue;
+
+				lanes.win[l] = next;
+				lanes.tree[l] = 0;
+				lanes.idx[l] = 1;
+				lanes.o[l] = 0.0f;
+				lanes.p[l] = &row[(int)scale.cols[next]];
+				PREFETCH(&lanes.p[l][offsets[2]]);
+				PREFETCH(&lanes.p[l][offsets[3]]);
+				++next;
+				++nactive;
+			}
+
+			while (nactive)
+				for (int l = 0; l < nwindows; ++l)
+				{
+					if (lanes.win[l] < 0)
+						continue;
+
+					const uint8_t *p = lanes.p[l];
+					const int32_t *off = &offsets[2*lanes.tree[l]*nnodes];
+
+					int idx = lanes.idx[l];
+					idx = 2*idx + (p[off[2*idx]] <= p[off[2*idx+1]]);
+
+					if (idx < nnodes)
+					{
+						lanes.idx[l] = idx;
+						PREFETCH(&p[off[2*idx]]);
+						PREFETCH(&p[off[2*idx+1]]);
+						continue;
+					}
+
+					// a leaf
+					const int t = lanes.tree[l];
+					lanes.o[l] += cascade.luts[t*nnodes + idx - nnodes];
+
+					int result = 0;
+					if (lanes.o[l] <= cascade.thresholds[t])
+						result = -1;
+					else if (t+1 == cascade.ntrees)
+						result = 1;
+
+					if (!result)
+					{
+						lanes.tree[l] = t+1;
+						lanes.idx[l] = 1;
+						PREFETCH(&p[off[2*nnodes + 2]]);
+						PREFETCH(&p[off[2*nnodes + 3]]);
+						continue;
+					}
+
+					outputs[lanes.win[l]] = lanes.o[l] - cascade.thresholds[cascade.ntrees-1];
+					passed[lanes.win[l]] = result == 1;
+
+					if (next == j1)
+					{
+						lanes.win[l] = -1;
+						--nactive;
+						continue;
+					}
+
+					lanes.win[l] = next;
+					lanes.tree[l] = 0;
+					lanes.idx[l] = 1;
+					lanes.o[l] = 0.0f;
+					lanes.p[l] = &row[(int)scale.cols[next]];
+					PREFETCH(&lanes.p[l][offsets[2]]);
+					PREFETCH(&lanes.p[l][offsets[3]]);
+					++next;
+				}
+
+			for (size_t j = j0; j < j1; ++j)
+			{
+				if (!passed[j])
+					continue;
+
+				if (ndetections >= maxndetections)
+					return ndetections;
+
+				qs[ndetections] = outputs[j];
+				rs[ndetections] = scale.rows[i];
+				cs[ndetections] = scale.cols[j];
+				ss[ndetections] = scale.s;
+				++ndetections;
+			}
+
+			ndetections = scan_scale<D>(rs, cs, ss, qs, ndetections, maxndetections, plan, scale, 0, pixels,
+				i, i+1, j1, scale.cols.size());
+		}
+	}
+
+	return ndetections;
+}
+
+int find_objects_interleaved(
+	float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	const ScanPlan &plan, const uint8_t *pixels, int nwindows)
+{
+	nwindows = std::min(std::max(1, nwindows), MAX_INTERLEAVED_WINDOWS);
+
+	CALL_FOR_TDEPTH(plan.cascade->tdepth, find_objects_interleaved, rs, cs, ss, qs, maxndetections, plan, pixels, nwindows);
+}
+
+// classify_window for an image in the TiledImage layout, the binary tests given as (row, column)
+// offsets of both of their pixels from the centre, whose row and column offsets in the image are
+// at rowoffsets and coloffsets
+template <int D>
+static inline int classify_window(const CascadeTables &cascade, const int16_t *deltas,
+	float *o, const uint8_t *pixels, const int *rowoffsets, const int *coloffsets)
+{
+	const int tdepth = D ? D : cascade.tdepth;
+	const int nnodes = 1<<tdepth;
+
+	*o = 0.0f;
+	for (int i = 0; i < cascade.ntrees; ++i)
+	{
+		const int16_t *d = &deltas[4*i*nnodes];
+
+		int idx = 1;
+		for (int j = 0; j < tdepth; ++j)
+			idx = 2*idx + (pixels[rowoffsets[d[4*idx+0]] + coloffsets[d[4*idx+1]]] <=
+				pixels[rowoffsets[d[4*idx+2]] + coloffsets[d[4*idx+3]]]);
+
+		*o += cascade.luts[i*nnodes + idx - nnodes];
+
+		if (*o <= cascade.thresholds[i])
+			return -1;
+	}
+
+	*o -= cascade.thresholds[cascade.ntrees-1];
+
+	return 1;
+}
+
+// the same, for the windows near the border (r and c in 1/256 pixels, sr and sc the window size)
+template <int D>
+static inline int classify_window(const CascadeTables &cascade,
+	float *o, const uint8_t *pixels, int r, int c, int sr, int sc, int ntilecols)
+{
+	const int tdepth = D ? D : cascade.tdepth;
+	const int nnodes = 1<<tdepth;
+
+	*o = 0.0f;
+	for (int i = 0; i < cascade.ntrees; ++i)
+	{
+		const int16_t (*t)[4] = &cascade.tcodes[i*nnodes];
+
+		int idx = 1;
+		for (int j = 0; j < tdepth; ++j)
+			idx = 2*idx + (pixels[get_tiled_index((r + t[idx][0]*sr)/256, (c + t[idx][1]*sc)/256, ntilecols)] <=
+				pixels[get_tiled_index((r + t[idx][2]*sr)/256, (c + t[idx][3]*sc)/256, ntilecols)]);
+
+		*o += cascade.luts[i*nnodes + idx - nnodes];
+
+		if (*o <= cascade.thresholds[i])
+			return -1;
+	}
+
+	*o -= cascade.thresholds[cascade.ntrees-1];
+
+	return 1;
+}
+
+template <int D>
+static int find_objects(
+	float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	const ScanPlan &plan, const TiledImage &image)
+{
+	const CascadeTables &cascade = *plan.cascade;
+	const uint8_t *pixels = image.pixels();
+
+	int ndetections = 0;
+	for (size_t k = 0; k < plan.scales.size(); ++k)
+	{
+		const ScanScale &scale = plan.scales[k];
+
+		for (size_t i = 0; i < scale.rows.size(); ++i)
+		{
+			int r = 256*(int)scale.rows[i];
+			for (size_t j = 0; j < scale.cols.size(); ++j)
+			{
+				if (ndetections >= maxndetections)
+					return ndetections;
+
+				int c = 256*(int)scale.cols[j];
+				if (!window_inside(cascade, r, c, scale.sr, scale.sc, plan.nrows, plan.ncols))
+					continue;
+
+				float q;
+				int result;
+				if (r-cascade.maxr*scale.sr >= 0 && c-cascade.maxc*scale.sc >= 0)
+					result = classify_window<D>(cascade, &scale.deltas[0], &q, pixels,
+						&image.rowoffsets()[r/256], &image.coloffsets()[c/256]);
+				else
+					result = classify_window<D>(cascade, &q, pixels, r, c, scale.sr, scale.sc, image.ntilecols());
+
+				if (result != 1)
+					continue;
+
+				qs[ndetections] = q;
+				rs[ndetections] = scale.rows[i];
+				cs[ndetections] = scale.cols[j];
+				ss[ndetections] = scale.s;
+				++ndetections;
+			}
+		}
+	}
+
+	return ndetections;
+}
+
+int find_objects(
+	float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	const ScanPlan &plan, const TiledImage &image)
+{
+	if (!plan.cascade || !plan.tiled)
+		return 0;
+
+	CALL_FOR_TDEPTH(plan.cascade->tdepth, find_objects, rs, cs, ss, qs, maxndetections, plan, image);
+}
+
+// rows of a band detector are this many bytes apart, rounded up
+#define STREAMING_ALIGNMENT 16
+
+StreamingDetector::StreamingDetector() :
+	first(0),
+	received(0)
+{}
+
+void StreamingDetector::start(const CascadeTables &cascade, int nrows, int ncols,
+	float scalefactor, float stridefactor, float minsize, float maxsize)
+{
+	const int ldim = (ncols + STREAMING_ALIGNMENT-1)/STREAMING_ALIGNMENT*STREAMING_ALIGNMENT;
+	plan.prepare(cascade, nrows, ncols, ldim, scalefactor, stridefactor, minsize, maxsize);
+
+	nextrows.assign(plan.scales.size(), 0);
+	nextcols.assign(plan.scales.size(), 0);
+
+	first = 0;
+	received = 0;
+}
+
+bool StreamingDetector::done() const
+{
+	for (size_t k = 0; k < plan.scales.size(); ++k)
+		if (nextrows[k] < plan.scales[k].rows.size())
+			return false;
+
+	return true;
+}
+
+// the rows below this one are not needed by any window still to be classified
+int StreamingDetector::get_first_needed_row() const
+{
+	int row = received;
+	for (size_t k = 0; k < plan.scales.size(); ++k)
+	{
+		const ScanScale &scale = plan.scales[k];
+		if (nextrows[k] < scale.rows.size())
+		{
+			const int r = 256*(int)scale.rows[nextrows[k]];
+			row = std::min(row, std::max(0, (r - plan.cascade->maxr*scale.sr)/256));
+		}
+	}
+
+	return row;
+}
+
+template <int D>
+int StreamingDetector::scan(float *rs, float *cs, float *ss, float *qs, int maxndetections)
+{
+	const CascadeTables &cascade = *plan.cascade;
+
 	int ndetections = 0;
+	for (size_t k = 0; k < plan.scales.size(); ++k)
+	{
+		const ScanScale &scale = plan.scales[k];
+
+		for (size_t &i = nextrows[k]; i < scale.rows.size(); ++i)
+		{
+			const int r = 256*(int)scale.rows[i];
+
+			// the rows below the image are never visited, the others wait for their last row
+			if ((r + cascade.maxr*scale.sr)/256 >= received && received < plan.nrows)
+				break;
+
+			// the buffer holds rows first and up, and (r + t*sr)/256 - first == (r - 256*first + t*sr)/256
+			// for the rows of any window inside the image (first is 0 while windows reaching above row 0 wait)
+			const int rb = r - 256*first;
+			const uint8_t *row = &buffer[(r/256 - first)*plan.ldim];
+			const bool rowinside = r - cascade.maxr*scale.sr >= 0;
+
+			for (size_t &j = nextcols[k]; j < scale.cols.size(); ++j)
+			{
+				if (ndetections >= maxndetections)
+					return ndetections;
+
+				const int c = 256*(int)scale.cols[j];
+				if (!window_inside(cascade, r, c, scale.sr, scale.sc, plan.nrows, plan.ncols))
+					continue;
+
+				float q;
+				int result;
+				if (rowinside && c - cascade.maxc*scale.sc >= 0)
+					result = classify_window<D>(cascade, &scale.offsets[0], &q, &row[c/256]);
+				else
+					result = classify_window<D>(cascade, &q, rb, c, scale.sr, scale.sc, &buffer[0], plan.ldim);
+
+				if (result != 1)
+					continue;
+
+				qs[ndetections] = q;
+				rs[ndetections] = scale.rows[i];
+				cs[ndetections] = scale.cols[j];
+				ss[ndetections] = scale.s;
+				++ndetections;
+			}
+
+			nextcols[k] = 0;
+		}
+	}
+
+	return ndetections;
+}
+
+int StreamingDetector::push(float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	const uint8_t *pixels, int nbandrows, int ldim)
+{
+	if (!plan.cascade)
+		return 0;
+
+	nbandrows = std::max(0, std::min(nbandrows, plan.nrows - received));
+
+	if (nbandrows > 0)
+	{
+		const size_t rowsize = plan.ldim;
+
+		// drop the rows that are not needed any more once the buffer is full,
+		// and grow it if the kept rows and the band still do not fit
+		if ((size_t)(received + nbandrows - first)*rowsize > buffer.size())
+		{
+			const int keep = get_first_needed_row();
+			if (keep > first)
+			{
+				if (received > keep)
+					memmove(&buffer[0], &buffer[(keep - first)*rowsize], (received - keep)*rowsize);
+				first = keep;
+			}
+
+			const size_t size = (size_t)(received + nbandrows - first)*rowsize;
+			if (size > buffer.size())
+				buffer.resize(2*size);
+		}
+
+		for (int r = 0; r < nbandrows; ++r)
+			memcpy(&buffer[(received - first + r)*rowsize], &pixels[(size_t)r*ldim], plan.ncols);
+		received += nbandrows;
+	}
+
+	if (buffer.empty())
+		return 0;
+
+	CALL_FOR_TDEPTH(plan.cascade->tdepth, scan, rs, cs, ss, qs, maxndetections);
+}
+
+// roughly how many windows one scan task of find_objects_mt should evaluate
+#define MT_TASK_WINDOWS 4096
+
+int find_objects_mt(
+	float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	int (*detection_func)(float*, int, int, int, const uint8_t*, int, int, int),
+	const uint8_t* pixels, int nrows, int ncols, int ldim,
+	float scalefactor, float stridefactor, float minsize, float maxsize,
+	WorkStealingPool &pool, int nthreads)
+{
+	struct Scale
+	{
+		float s;
+		std::vector<float> rows;
+		std::vector<float> cols;
+	};
+
+	struct Task
+	{
+		int scale;
+		int row0;
+		int row1;
+		std::vector<float> dets;  // (r, c, s, q) quadruples
+	};
+
+	std::vector<Scale> scales;
 	for (float s = minsize; s <= maxsize; s *= scalefactor)
 	{
 		float dr = std::max(stridefactor * s, 1.0f);
 		float dc = dr;
 
-		for (float r = s/2+1; r <= nrows-s/2-1; r += dr)
+		scales.push_back(Scale());
+		scales.back().s = s;
+		get_scan_positions(scales.back().rows, s, dr, nrows);
+		get_scan_positions(scales.back().cols, s, dc, ncols);
+	}
+
+	// split every scale into row bands of similar amount of windows
+	// tasks are listed in the serial scan order, so merging them in order
+	// reproduces the output of find_objects
+	std::vector<Task> tasks;
+	for (int i = 0; i < (int)scales.size(); ++i)
+	{
+		int nr = scales[i].rows.size();
+		int nc = scales[i].cols.size();
+		if (!nr || !nc)
+			continue;
+
+		int band = std::max(1, MT_TASK_WINDOWS / nc);
+		for (int r = 0; r < nr; r += band)
+		{
+			tasks.push_back(Task());
+			tasks.back().scale = i;
+			tasks.back().row0 = r;
+			tasks.back().row1 = std::min(nr, r + band);
+		}
+	}
+
+	OrderedCounts found(tasks.size());
+	pool.run_in_order(tasks.size(), [&](int t)
+	{
+		Task &task = tasks[t];
+		const Scale &scale = scales[task.scale];
+		int s = scale.s;
+
+		// if the tasks before this one are done and already have enough detections,
+		// the rest can't make it into the output
+		const int before = found.get_before(0, t, maxndetections);
+		const int maxn = maxndetections - before;
+
+		for (int i = task.row0; i < task.row1; ++i)
 		{
-			for (float c = s/2+1; c <= ncols-s/2-1; c += dc)
+			float r = scale.rows[i];
+			for (size_t j = 0; j < scale.cols.size(); ++j)
 			{
-				if (ndetections >= maxndetections)
-					break;
+				if ((int)task.dets.size()/4 >= maxn)
+				{
+					found.set(t, task.dets.size()/4);
+					return;
+				}
 
+				float c = scale.cols[j];
 				float q;
 				if (detection_func(&q, r, c, s, pixels, nrows, ncols, ldim) != 1)
 					continue;
 
-				qs[ndetections] = q;
-				rs[ndetections] = r;
-				cs[ndetections] = c;
-				ss[ndetections] = s;
-				++ndetections;
+				task.dets.push_back(r);
+				task.dets.push_back(c);
+				task.dets.push_back(scale.s);
+				task.dets.push_back(q);
 			}
 		}
+
+		found.set(t, task.dets.size()/4);
+	}, nthreads);
+
+	int ndetections = 0;
+	for (size_t t = 0; t < tasks.size() && ndetections < maxndetections; ++t)
+	{
+		const std::vector<float> &dets = tasks[t].dets;
+		for (size_t i = 0; i < dets.size() && ndetections < maxndetections; i += 4)
+		{
+			rs[ndetections] = dets[i + 0];
+			cs[ndetections] = dets[i + 1];
+			ss[ndetections] = dets[i + 2];
+			qs[ndetections] = dets[i + 3];
+			++ndetections;
+		}
 	}
+
 	return ndetections;
 }
 
@@ -69,76 +1539,266 @@ float get_overlap(float r1, float c1, float s1, float r2, float c2, float s2)
 	return overr*overc/(s1*s1+s2*s2-overr*overc);
 }
 
-void ccdfs(int a[], int i, float rs[], float cs[], float ss[], int n)
+/*
+	Detections are clustered into the connected components of the "overlap > 0.3" graph.
+	Two windows with sizes s1 <= s2 can only overlap that much if s2 < s1/sqrt(0.3) < 2*s1,
+	and as the intersection is at most s1*((s1+s2)/2 - |r1-r2|), their centres have to be
+	less than 0.55*s1 apart in both directions.
+	So every detection is put in a grid cell keyed on its size exponent E (2^(E-1) <= s < 2^E)
+	and its position in cells of 2^E pixels, and only the 3x3 cells around it
+	in the grids of exponents E-1, E and E+1 have to be searched.
+*/
+
+static inline int64_t get_grid_cell(int e, float x)
+{
+	return (int64_t)floorf(ldexpf(x, -e));
+}
+
+static inline uint64_t get_grid_key(int e, int64_t cr, int64_t cc)
+{
+	return ((uint64_t)(e+128) << 56) | ((uint64_t)((cr + (1<<27)) & 0xFFFFFFF) << 28) |
+		(uint64_t)((cc + (1<<27)) & 0xFFFFFFF);
+}
+
+static inline int find_root(std::vector<int> &parents, int i)
+{
+	while (parents[i] != i)
+	{
+		parents[i] = parents[parents[i]];
+		i = parents[i];
+	}
+
+	return i;
+}
+
+// labels the detections with their component (1, 2, ... in the order of their first detection)
+// and returns the amount of components
+static int find_connected_components(std::vector<int> &a, const float rs[], const float cs[], const float ss[], int n)
 {
-	for (int j = 0; j < n; ++j)
+	std::vector<int> exps(n);
+	std::vector<std::pair<uint64_t, int> > cells(n);
+	for (int i = 0; i < n; ++i)
+	{
+		frexpf(ss[i], &exps[i]);
+		cells[i] = std::make_pair(get_grid_key(exps[i],
+			get_grid_cell(exps[i], rs[i]), get_grid_cell(exps[i], cs[i])), i);
+	}
+	std::sort(cells.begin(), cells.end());
+
+	std::vector<int> parents(n);
+	for (int i = 0; i < n; ++i)
+		parents[i] = i;
+
+	// a cell whose detections are all connected stays that way,
+	// so once it is also connected to detection i it can be skipped as a whole
+	// (this keeps dense clusters from being compared pair by pair over and over)
+	std::vector<char> connected(n, 0);  // indexed by the first position of the cell in cells
+
+	for (int i = 0; i < n; ++i)
 	{
-		if (a[j] == 0 && get_overlap(rs[i], cs[i], ss[i], rs[j], cs[j], ss[j])>0.3f)
+		for (int e = exps[i]-1; e <= exps[i]+1; ++e)
 		{
-			a[j] = a[i];
+			const int64_t cr = get_grid_cell(e, rs[i]);
+			const int64_t cc = get_grid_cell(e, cs[i]);
+
+			for (int dr = -1; dr <= 1; ++dr)
+				for (int dc = -1; dc <= 1; ++dc)
+				{
+					const uint64_t key = get_grid_key(e, cr+dr, cc+dc);
+
+					const int start = std::lower_bound(cells.begin(), cells.end(), std::make_pair(key, 0)) - cells.begin();
+					if (start == n || cells[start].first != key)
+						continue;
+
+					const int first = cells[start].second;
+					if (connected[start] && find_root(parents, first) == find_root(parents, i))
+						continue;
 
-			ccdfs(a, j, rs, cs, ss, n);
+					int k = start;
+					for (; k < n && cells[k].first == key; ++k)
+					{
+						const int j = cells[k].second;
+						if (j <= i)
+							continue;
+
+						// in dense clusters most pairs are already connected
+						int ri = find_root(parents, i);
+						int rj = find_root(parents, j);
+						if (ri == rj || get_overlap(rs[i], cs[i], ss[i], rs[j], cs[j], ss[j]) <= 0.3f)
+							continue;
+
+						// the root of a component is always its first detection
+						if (ri < rj)
+							parents[rj] = ri;
+						else
+							parents[ri] = rj;
+					}
+
+					if (!connected[start])
+					{
+						const int root = find_root(parents, first);
+
+						int l = start + 1;
+						while (l < k && find_root(parents, cells[l].second) == root)
+							++l;
+						connected[start] = l == k;
+					}
+				}
 		}
 	}
+
+	int ncc = 0;
+	for (int i = 0; i < n; ++i)
+	{
+		int root = find_root(parents, i);
+		a[i] = root == i ? ++ncc : a[root];
+	}
+
+	return ncc;
 }
 
-int find_connected_components(int a[], float rs[], float cs[], float ss[], int n)
+int cluster_detections(float *rs, float *cs, float *ss, float *qs, int n)
 {
-	if (!n)
+	if (n <= 0)
 		return 0;
 
-	memset(a, 0, n * sizeof(float));
+	std::vector<int> a(n);
+	int ncc = find_connected_components(a, rs, cs, ss, n);
 
-	int ncc = 0;
-	int cc = 1;
+	// sums in detection order, as before
+	std::vector<float> sumqs(ncc, 0.0f), sumrs(ncc, 0.0f), sumcs(ncc, 0.0f), sumss(ncc, 0.0f);
+	std::vector<int> counts(ncc, 0);
 	for (int i = 0; i < n; ++i)
 	{
-		if (a[i] != 0)
-			continue;
-		a[i] = cc;
-		ccdfs(a, i, rs, cs, ss, n);
-		++ncc;
-		++cc;
+		int cc = a[i] - 1;
+
+		sumqs[cc] += qs[i];
+		sumrs[cc] += rs[i];
+		sumcs[cc] += cs[i];
+		sumss[cc] += ss[i];
+		++counts[cc];
+	}
+
+	for (int cc = 0; cc < ncc; ++cc)
+	{
+		qs[cc] = sumqs[cc];  // accumulated confidence measure
+
+		rs[cc] = sumrs[cc]/counts[cc];
+		cs[cc] = sumcs[cc]/counts[cc];
+		ss[cc] = sumss[cc]/counts[cc];
 	}
 
 	return ncc;
 }
 
-int cluster_detections(float *rs, float *cs, float *ss, float *qs, int n)
+DetectionClusters::DetectionClusters() :
+	lasts(0.0f),
+	nclusters(0)
+{}
+
+void DetectionClusters::clear()
 {
-	int a[4096];
-	int ncc = find_connected_components(a, rs, cs, ss, n);
-	if (!ncc)
-		return 0;
+	clusters.clear();
+	active.clear();
+	lasts = 0.0f;
+	nclusters = 0;
+}
+
+void DetectionClusters::add(float r, float c, float s, float q)
+{
+	// find_objects goes through the sizes in increasing order,
+	// a cluster of windows less than half the size of the current ones can not be reached by it anymore
+	// (overlap > 0.3 needs the sizes within a factor of 1/sqrt(0.3))
+	// if the sizes go down, every cluster comes back into play
+	if (s < lasts)
+	{
+		active.clear();
+		for (size_t k = 0; k < clusters.size(); ++k)
+			if (clusters[k].n)
+				active.push_back(k);
+	}
+	lasts = s;
 
-	int idx = 0;
-	for (int cc = 1; cc <= ncc; ++cc)
+	int target = -1;
+	int nactive = 0;
+	for (size_t k = 0; k < active.size(); ++k)
 	{
-		float sumqs=0.0f, sumrs=0.0f, sumcs=0.0f, sumss=0.0f;
+		Cluster &cl = clusters[active[k]];
+		if (!cl.n || 2*cl.sums < s*cl.n)
+			continue;
+		active[nactive++] = active[k];
+
+		if (get_overlap(r, c, s, cl.sumr/cl.n, cl.sumc/cl.n, cl.sums/cl.n) <= 0.3f)
+			continue;
 
-		int k = 0;
-		for (int i = 0; i < n; ++i)
+		// several clusters are merged into the one started first
+		if (target < 0)
+			target = active[k];
+		else
 		{
-			if (a[i] != cc)
-				continue;
+			Cluster &a = clusters[std::min(target, active[k])];
+			Cluster &b = clusters[std::max(target, active[k])];
+
+			a.sumr += b.sumr;
+			a.sumc += b.sumc;
+			a.sums += b.sums;
+			a.sumq += b.sumq;
+			a.n += b.n;
+			b.n = 0;
 
-			sumqs += qs[i];
-			sumrs += rs[i];
-			sumcs += cs[i];
-			sumss += ss[i];
-			++k;
+			target = std::min(target, active[k]);
+			--nclusters;
 		}
+	}
+	active.resize(nactive);
+
+	if (target < 0)
+	{
+		Cluster cl = {0.0f, 0.0f, 0.0f, 0.0f, 0};
+		target = clusters.size();
+		clusters.push_back(cl);
+		active.push_back(target);
+		++nclusters;
+	}
+
+	Cluster &cl = clusters[target];
+	cl.sumr += r;
+	cl.sumc += c;
+	cl.sums += s;
+	cl.sumq += q;
+	++cl.n;
+}
 
-		qs[idx] = sumqs;  // accumulated confidence measure
+int DetectionClusters::get(float *rs, float *cs, float *ss, float *qs, int maxndetections) const
+{
+	int n = 0;
+	for (size_t k = 0; k < clusters.size() && n < maxndetections; ++k)
+	{
+		const Cluster &cl = clusters[k];
+		if (!cl.n)
+			continue;
+
+		qs[n] = cl.sumq;  // accumulated confidence measure
 
-		rs[idx] = sumrs/k;
-		cs[idx] = sumcs/k;
-		ss[idx] = sumss/k;
+		rs[n] = cl.sumr/cl.n;
+		cs[n] = cl.sumc/cl.n;
+		ss[n] = cl.sums/cl.n;
 
-		++idx;
+		++n;
 	}
 
-	return idx;
+	return n;
+}
+
+int find_objects(DetectionClusters &clusters,
+	int (*detection_func)(float*, int, int, int, const uint8_t*, int, int, int),
+	const uint8_t *pixels, int nrows, int ncols, int ldim,
+	float scalefactor, float stridefactor, float minsize, float maxsize)
+{
+	FunctionClassifier classifier(detection_func);
+
+	return find_objects(clusters, classifier,
+		pixels, nrows, ncols, ldim, scalefactor, stridefactor, minsize, maxsize);
 }
 
 int find_faces_cpu(
@@ -148,7 +1808,7 @@ int find_faces_cpu(
 {
 	return find_objects(
 		rs, cs, ss, qs, maxndetections,
-		facedet,
+		facedet_tables,
 		pixels, nrows, ncols, ldim,
 		scalefactor, stridefactor, minsize, maxsize);
 }
@@ -158,12 +1818,15 @@ int find_faces(bool use_cuda,
 	const uint8_t *pixels, int nrows, int ncols, int ldim,
 	float scalefactor, float stridefactor, float minsize, float maxsize)
 {
+#ifdef HAVE_CUDA
 	if (use_cuda)
 		return find_faces_cuda(rs, cs, ss, qs, maxndetections,
 			pixels, nrows, ncols, ldim,
 			scalefactor, stridefactor, minsize, maxsize);
-	else
-		return find_faces_cpu(rs, cs, ss, qs, maxndetections,
-			pixels, nrows, ncols, ldim,
-			scalefactor, stridefactor, minsize, maxsize);
+#endif
+
+	// without CUDA, use_cuda falls back to the CPU
+	return find_faces_cpu(rs, cs, ss, qs, maxndetections,
+		pixels, nrows, ncols, ldim,
+		scalefactor, stridefactor, minsize, maxsize);
 }
@@ -20,8 +20,61 @@
 #ifndef PICORNT_H
 #define PICORNT_H
 
+#include <stddef.h>
 #include <stdint.h>
 
+#include <vector>
+
+// classification cascade tables (picogen emits one of these as <name>_tables)
+struct CascadeTables
+{
+	float tsr;  // row scale ratio
+	float tsc;  // column scale ratio
+	int tdepth;  // tree depth
+	int ntrees;  // amount of trees
+	int maxr;  // max absolute row offset of the binary tests (in 1/256 of the window size)
+	int maxc;  // max absolute column offset of the binary tests
+
+	// (1<<tdepth) binary tests (r1, c1, r2, c2) per tree, already rotated
+	// node indices start from 1, the first test of every tree is unused
+	const int16_t (*tcodes)[4];
+	const float *luts;  // (1<<tdepth) leaf outputs per tree
+	const float *thresholds;  // one rejection threshold per tree
+
+	// unique across the process for every set of tables a RuntimeCascade holds (taken when it is created
+	// and on every load), so a plan or compiled code is never reused for other tables at the same address;
+	// 0 for fixed tables
+	int generation;
+};
+
+// classification cascade loaded at run time from a file written by picolrn,
+// so that new models can be used without running picogen and recompiling
+// tables() can be passed to every find_objects variant that takes CascadeTables
+class RuntimeCascade
+{
+public:
+	RuntimeCascade();
+
+	// rotation (in radians) and threshold_shift have the same meaning as picogen's -r and -s
+	bool load(const char *path, double rotation = 0.0, double threshold_shift = 0.0);
+
+	bool empty() const { return data.ntrees == 0; }
+	const CascadeTables &tables() const { return data; }
+
+	// classifies one window, same as a function generated by picogen from this cascade
+	int classify(float *o, int r, int c, int s,
+		const uint8_t *pixels, int nrows, int ncols, int ldim) const;
+
+private:
+	RuntimeCascade(const RuntimeCascade&);
+	RuntimeCascade& operator=(const RuntimeCascade&);
+
+	CascadeTables data;
+	std::vector<int16_t> tcodes;
+	std::vector<float> luts;
+	std::vector<float> thresholds;
+};
+
 int find_faces(bool use_cuda,
 	float *rs, float *cs, float *ss, float *qs, int maxndetections,
 	const uint8_t *pixels, int nrows, int ncols, int ldim,
@@ -32,6 +85,707 @@ int find_objects(float *rs, float *cs, float *ss, float *qs, int maxndetections,
 	const uint8_t *pixels, int nrows, int ncols, int ldim,
 	float scalefactor, float stridefactor, float minsize, float maxsize);
 
+// same as find_objects, with the "interior" function picogen emits next to detection_func
+// (<name>_interior, which has no image-bounds test) used for the windows whose binary tests
+// are all inside the image; detection_func is only called in the border strip
+// cascade is the <name>_tables descriptor (only tsr, tsc, maxr and maxc are used)
+int find_objects(float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	int (*detection_func)(float*, int, int, int, const uint8_t*, int, int, int),
+	int (*interior_func)(float*, int, int, int, const uint8_t*, int),
+	const CascadeTables &cascade,
+	const uint8_t *pixels, int nrows, int ncols, int ldim,
+	float scalefactor, float stridefactor, float minsize, float maxsize);
+
+class WorkStealingPool;
+
+// same as find_objects, but the scan is split into (scale, row band) tasks
+// which are processed by the threads of pool (keep it across frames so that its threads are reused)
+// detections and their order are the same as in find_objects
+// detection_func must be safe to call from several threads at once
+// at most nthreads threads of pool are used (nthreads <= 0 means all of them)
+int find_objects_mt(float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	int (*detection_func)(float*, int, int, int, const uint8_t*, int, int, int),
+	const uint8_t *pixels, int nrows, int ncols, int ldim,
+	float scalefactor, float stridefactor, float minsize, float maxsize,
+	WorkStealingPool &pool, int nthreads = 0);
+
+// same as find_objects, but the windows of every row are classified in batches
+// by a SIMD kernel (AVX2 or SSE4.1, depending on the CPU) evaluating the cascade tables
+// detections are the same as with the function generated by picogen from this cascade
+int find_objects(float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	const CascadeTables &cascade,
+	const uint8_t *pixels, int nrows, int ncols, int ldim,
+	float scalefactor, float stridefactor, float minsize, float maxsize);
+
+// same as find_objects with cascade tables, but every scale is evaluated breadth-first:
+// a block of treeblock trees is run over all windows still alive, which are then compacted
+// (keeping their scan order) before the next block, so that the tables of the current trees
+// stay in the L1 cache instead of being streamed again for every window
+int find_objects_bfs(float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	const CascadeTables &cascade,
+	const uint8_t *pixels, int nrows, int ncols, int ldim,
+	float scalefactor, float stridefactor, float minsize, float maxsize,
+	int treeblock);
+
+// classifies one window with the cascade tables, the same way as the function generated by picogen
+int classify_window(const CascadeTables &cascade, float *o, int r, int c, int s,
+	const uint8_t *pixels, int nrows, int ncols, int ldim);
+
+// one scale of a ScanPlan
+struct ScanScale
+{
+	float s;  // window size
+	int sr;  // window size used by the binary tests (rows)
+	int sc;  // window size used by the binary tests (columns)
+	std::vector<float> rows;  // window centres, the same ones find_objects visits
+	std::vector<float> cols;
+
+	// pixel offsets of both sides of every binary test from the window centre,
+	// 2*(1<<tdepth) per tree, in the same order as the cascade tcodes
+	std::vector<int32_t> offsets;
+
+	// the same as (row, column) offsets, 4*(1<<tdepth) per tree, for find_objects with a TiledImage
+	// (only built if the plan is prepared with tiled, empty otherwise)
+	std::vector<int16_t> deltas;
+};
+
+// the windows find_objects visits for a cascade, an image geometry and scan parameters,
+// with the binary tests of each scale precomputed as pixel offsets
+// keep it across frames, prepare() rebuilds it only when something has changed
+class ScanPlan
+{
+public:
+	ScanPlan();
+
+	// returns true if the plan had to be (re)built
+	// tiled also builds the offsets find_objects with a TiledImage needs
+	bool prepare(const CascadeTables &cascade, int nrows, int ncols, int ldim,
+		float scalefactor, float stridefactor, float minsize, float maxsize, bool tiled = false);
+
+	const CascadeTables *cascade;
+	int generation;  // of the cascade tables the plan was built for
+	int nrows;
+	int ncols;
+	int ldim;
+	float scalefactor;
+	float stridefactor;
+	float minsize;
+	float maxsize;
+	bool tiled;
+
+	std::vector<ScanScale> scales;
+};
+
+// same as find_objects with cascade tables, for a prepared scan plan
+// the node tests become pixels[centre + offset1] <= pixels[centre + offset2]
+int find_objects(float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	const ScanPlan &plan, const uint8_t *pixels);
+
+// same as find_objects with a scan plan, but the image is processed in tiles of tilesize x tilesize
+// window centres: all the scales whose windows (with their binary tests) fit in a tile are run over
+// one tile before the next, so that its pixels stay in the L2 cache; the larger scales follow as usual
+// tilesize <= 0 selects DEFAULT_TILE_SIZE
+// the detections are the same, but ordered by tile (which matters only if maxndetections is reached)
+#define DEFAULT_TILE_SIZE 256
+int find_objects_tiled(float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	const ScanPlan &plan, const uint8_t *pixels, int tilesize);
+
+// range of object sizes for every image row, for fixed cameras where the size of an object follows
+// from its position (perspective); the scan skips the windows whose size is outside the range of the
+// row of their centre
+// the prior is set explicitly, or learned from detections: a line s = a + b*r is fit to them and
+// widened to hold (almost) all of their sizes, times margin on both sides
+#define SCALE_PRIOR_MIN_SAMPLES 16
+class ScalePrior
+{
+public:
+	// minsizes[r] and maxsizes[r] for every row r < nrows
+	void set(const float *minsizes, const float *maxsizes, int nrows);
+
+	// piecewise linear, through n knots (rows[k], minsizes[k], maxsizes[k]) with rows increasing,
+	// constant above the first and below the last one
+	void set_knots(const float *rows, const float *minsizes, const float *maxsizes, int n, int nrows);
+
+	// detections (best clustered ones, one per object) to learn from
+	void add_samples(const float *rs, const float *ss, int n);
+	void clear_samples() { samples.clear(); }
+	int nsamples() const { return samples.size()/2; }
+
+	// returns false (and keeps the prior) if there are fewer than SCALE_PRIOR_MIN_SAMPLES samples
+	bool learn(int nrows, float margin);
+
+	// with no prior every size is allowed
+	void clear() { minsizes.clear(); maxsizes.clear(); }
+	bool empty() const { return minsizes.empty(); }
+
+	// rows outside the image take the range of the closest one
+	bool allows(float r, float s) const
+	{
+		if (minsizes.empty())
+			return true;
+
+		int i = (int)r;
+		i = i < 0 ? 0 : i >= (int)minsizes.size() ? (int)minsizes.size()-1 : i;
+
+		return s >= minsizes[i] && s <= maxsizes[i];
+	}
+
+private:
+	std::vector<float> minsizes;
+	std::vector<float> maxsizes;
+	std::vector<float> samples;  // (r, s) pairs
+};
+
+// same as find_objects, but only the windows the prior allows are classified
+int find_objects(float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	int (*detection_func)(float*, int, int, int, const uint8_t*, int, int, int),
+	const ScalePrior &prior,
+	const uint8_t *pixels, int nrows, int ncols, int ldim,
+	float scalefactor, float stridefactor, float minsize, float maxsize);
+
+// same, for a prepared scan plan
+int find_objects(float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	const ScanPlan &plan, const ScalePrior &prior, const uint8_t *pixels);
+
+// same as find_objects with a scan plan, in two passes: first the windows at a coarse stride
+// (coarsestridefactor instead of the plan's stridefactor) are classified by the first ntrees trees
+// of the cascade only, with their rejection thresholds lowered by slack; then the windows of the plan
+// within one coarse stride of a window that passed are classified as usual
+// the detections are a subset of those of find_objects, in the same order
+int find_objects_coarse_to_fine(float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	const ScanPlan &plan, const uint8_t *pixels,
+	float coarsestridefactor, int ntrees, float slack);
+
+// same as find_objects with a scan plan, but a window rejected by tree t < nskips of the cascade
+// makes the scan skip the next skips[t] windows of its row; windows that get further are followed
+// by the next one as usual, so the scan is dense around them (e.g. skips {3, 2, 1} for the faces)
+// the detections are a subset of those of find_objects, in the same order
+int find_objects_adaptive(float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	const ScanPlan &plan, const uint8_t *pixels,
+	const int *skips, int nskips);
+
+// same as find_objects with a scan plan, but at the scales with a column stride of at most
+// DENSE_MAX_STRIDE pixels, the first ntrees trees of the cascade are evaluated for every pixel
+// of a row at once (each node test compares two shifted copies of the row, 16 or 32 pixels per
+// SIMD instruction); only the windows that survive them go through the rest of the cascade
+// the detections are the same, in the same order
+#define DENSE_MAX_STRIDE 4.0f
+int find_objects_dense(float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	const ScanPlan &plan, const uint8_t *pixels, int ntrees);
+
+// same as find_objects with a scan plan, but nwindows windows of a row (at most MAX_INTERLEAVED_WINDOWS)
+// are evaluated at once, one tree level each in turn, with the pixels of the next node test of every
+// window prefetched while the others are evaluated, so that the cache misses of large scales overlap
+// instead of stalling every window's chain of dependent loads
+// the detections are the same, in the same order
+#define MAX_INTERLEAVED_WINDOWS 32
+int find_objects_interleaved(float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	const ScanPlan &plan, const uint8_t *pixels, int nwindows);
+
+// copy of an image with its rows padded to whole cache lines (and kept off multiples of 4096 bytes,
+// which would map the rows of a window to the same cache sets), with some slack after the last row,
+// in huge pages if the system provides them; keep it across frames so that the buffer is reused
+class PaddedImage
+{
+public:
+	PaddedImage();
+	~PaddedImage();
+
+	// returns false if the buffer could not be allocated
+	// (usehugepages only matters when the buffer has to grow)
+	bool copy(const uint8_t *pixels, int nrows, int ncols, int ldim, bool usehugepages = true);
+
+	const uint8_t *pixels() const { return data; }
+	int nrows() const { return rows; }
+	int ncols() const { return cols; }
+	int ldim() const { return stride; }
+
+	// whether the buffer is in huge pages (for transparent huge pages, whether they were requested)
+	bool huge() const { return hugepages; }
+
+private:
+	PaddedImage(const PaddedImage&);
+	PaddedImage& operator=(const PaddedImage&);
+
+	void release();
+
+	uint8_t *data;
+	void *mem;
+	size_t size, capacity;
+	bool mapped;
+	bool hugepages;
+	int rows, cols, stride;
+};
+
+// copy of an image in tiles of 8x8 pixels, one 64-byte cache line each (a tile is stored row by row,
+// the tiles of the image too), so that the pixel pairs a cascade compares around a large window touch
+// fewer cache lines than with rows; keep it across frames so that the buffer is reused
+// pixel (r, c) is at get_tiled_index(r, c, ntilecols()), the functions picogen emits as <name>_tiled
+// take ntilecols() in place of ldim
+#define TILED_IMAGE_TILE 8
+static inline int get_tiled_index(int r, int c, int ntilecols)
+{
+	const unsigned ur = r, uc = c;
+
+	return (ur/TILED_IMAGE_TILE*ntilecols + uc/TILED_IMAGE_TILE)*TILED_IMAGE_TILE*TILED_IMAGE_TILE +
+		ur%TILED_IMAGE_TILE*TILED_IMAGE_TILE + uc%TILED_IMAGE_TILE;
+}
+
+class TiledImage
+{
+public:
+	TiledImage();
+
+	void copy(const uint8_t *pixels, int nrows, int ncols, int ldim);
+
+	const uint8_t *pixels() const { return data; }
+	int nrows() const { return rows; }
+	int ncols() const { return cols; }
+	int ntilecols() const { return tilecols; }
+
+	// get_tiled_index(r, c, ntilecols()) is rowoffsets()[r] + coloffsets()[c]
+	const int *rowoffsets() const { return &rowtable[0]; }
+	const int *coloffsets() const { return &coltable[0]; }
+
+private:
+	TiledImage(const TiledImage&);
+	TiledImage& operator=(const TiledImage&);
+
+	std::vector<uint8_t> buffer;
+	uint8_t *data;  // the first tile, aligned to 64 bytes
+	int rows, cols, tilecols;
+	std::vector<int> rowtable, coltable;
+};
+
+// same as find_objects with a scan plan, for an image in the TiledImage layout
+// (the plan is prepared for the size of the image with tiled set, its ldim is not used)
+// returns 0 if the plan was not prepared with tiled
+int find_objects(float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	const ScanPlan &plan, const TiledImage &image);
+
+// find_objects with cascade tables for images that arrive as bands of rows (from a camera or a decoder):
+// each window is classified as soon as all the rows it needs are in, and the rows that no window
+// needs any more are dropped, so the rows kept are about twice as many as the largest window needs
+// the detections are those of find_objects, ordered by the band that completed them
+class StreamingDetector
+{
+public:
+	StreamingDetector();
+
+	// starts a frame, the parameters are those of find_objects
+	void start(const CascadeTables &cascade, int nrows, int ncols,
+		float scalefactor, float stridefactor, float minsize, float maxsize);
+
+	// adds the next nbandrows rows of the frame and returns the amount of detections they complete
+	// if there are more than maxndetections, the rest come with the next calls (nbandrows can be 0)
+	int push(float *rs, float *cs, float *ss, float *qs, int maxndetections,
+		const uint8_t *pixels, int nbandrows, int ldim);
+
+	// whether all the windows of the frame have been classified
+	bool done() const;
+
+	// rows received so far and rows currently kept
+	int nrowsreceived() const { return received; }
+	int nrowskept() const { return received - first; }
+
+private:
+	friend int find_objects(float*, float*, float*, float*, int,
+		StreamingDetector&, const CascadeTables&, int, const uint8_t*, int, int, int, float, float, float, float);
+
+	template <int D> int scan(float *rs, float *cs, float *ss, float *qs, int maxndetections);
+	int get_first_needed_row() const;
+
+	ScanPlan plan;
+	std::vector<size_t> nextrows, nextcols;  // next window of every scale
+	std::vector<uint8_t> buffer;  // frame rows first to received-1, plan.ldim bytes apart
+	std::vector<uint8_t> band;  // rows converted to luma by find_objects with a pixel format
+	int first;
+	int received;
+};
+
+// pixel formats of find_objects with a StreamingDetector
+#define PIXEL_FORMAT_GRAY 0
+#define PIXEL_FORMAT_NV12 1  // Y plane (nrows rows, ldim bytes apart), then interleaved UV
+#define PIXEL_FORMAT_I420 2  // Y plane, then the U and V planes
+#define PIXEL_FORMAT_RGB24 3  // packed, ldim is the row size in bytes
+#define PIXEL_FORMAT_BGR24 4
+#define PIXEL_FORMAT_BGRA 5
+
+// find_objects with cascade tables for frames in one of the pixel formats above
+// the Y plane of YUV frames is scanned in place; packed RGB is converted to luma (with the weights of
+// OpenCV's RGB to gray conversion) in bands of rows fed to the detector as the scan reaches them
+// detections are those of find_objects on the gray image, for packed formats in the order of the detector
+int find_objects(float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	StreamingDetector &detector, const CascadeTables &cascade,
+	int format, const uint8_t *data, int nrows, int ncols, int ldim,
+	float scalefactor, float stridefactor, float minsize, float maxsize);
+
+// native x86-64 code for a cascade, compiled at run time (see detect-jit.cpp)
+// the trees are unrolled into straight-line code, which evaluates the offsets of a ScanPlan
+class CascadeJit
+{
+public:
+	CascadeJit();
+	~CascadeJit();
+
+	// compiles the cascade and checks the code against classify_window on random windows
+	// returns false if the platform is not supported or the check fails,
+	// find_objects then falls back to the table evaluator
+	bool compile(const CascadeTables &cascade);
+
+	// same as compile, but only if the code is not of these tables yet (or they have been reloaded
+	// since), so that it can be called every frame; returns ready()
+	bool prepare(const CascadeTables &cascade);
+
+	bool ready() const { return func != 0; }
+	const CascadeTables *tables() const { return cascade; }
+	int generation() const { return tables_generation; }  // of the tables, see CascadeTables
+
+	// classifies the window centred at p with the offsets of a ScanPlan scale
+	int classify(float *o, const uint8_t *p, const int32_t *offsets) const
+	{
+		return func(o, p, offsets);
+	}
+
+private:
+	CascadeJit(const CascadeJit&);
+	CascadeJit& operator=(const CascadeJit&);
+
+	void release();
+
+	const CascadeTables *cascade;  // the tables last compiled, even if that failed
+	int tables_generation;
+	int (*func)(float*, const uint8_t*, const int32_t*);
+	void *code;
+	size_t codesize;
+};
+
+// same as find_objects with a scan plan, the windows are classified by the compiled cascade
+// (which has to be compiled from the same tables as the plan)
+int find_objects(float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	const ScanPlan &plan, const CascadeJit &jit, const uint8_t *pixels);
+
+// image pyramid for find_objects_pyramid, keep it across frames so that its buffers are reused
+// level 0 is the image itself, every next level is half the size of the previous one (2x2 averages)
+class ImagePyramid
+{
+public:
+	ImagePyramid();
+
+	void build(const uint8_t *pixels, int nrows, int ncols, int ldim, int nlevels);
+
+	int size() const { return (int)levels.size(); }
+	const uint8_t *pixels(int level) const { return levels[level].pixels; }
+	int nrows(int level) const { return levels[level].nrows; }
+	int ncols(int level) const { return levels[level].ncols; }
+	int ldim(int level) const { return levels[level].ldim; }
+
+private:
+	ImagePyramid(const ImagePyramid&);
+	ImagePyramid& operator=(const ImagePyramid&);
+
+	struct Level
+	{
+		const uint8_t *pixels;
+		int nrows, ncols, ldim;
+	};
+
+	std::vector<Level> levels;
+	std::vector<uint8_t> buffer;
+};
+
+// same as find_objects, but every window size is scanned on the smallest of nlevels pyramid levels
+// on which the windows are at most maxlevelsize pixels (so large objects are found on small images)
+// the sizes visited are the same as in find_objects, detections are in full-resolution coordinates
+int find_objects_pyramid(float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	int (*detection_func)(float*, int, int, int, const uint8_t*, int, int, int),
+	ImagePyramid &pyramid, int nlevels, float maxlevelsize,
+	const uint8_t *pixels, int nrows, int ncols, int ldim,
+	float scalefactor, float stridefactor, float minsize, float maxsize);
+
+// clusters of detections built while scanning, instead of from a buffer of raw detections:
+// a detection joins the clusters whose mean window it overlaps by more than 0.3 (merging them if
+// there are several) or starts a new one, so memory grows with the amount of objects, not of windows
+// for separate objects the clusters are the same as the ones of cluster_detections, which links
+// detections through any member instead of the mean and so can chain neighbouring objects together
+class DetectionClusters
+{
+public:
+	DetectionClusters();
+
+	void clear();
+	void add(float r, float c, float s, float q);
+
+	int size() const { return nclusters; }
+
+	// writes the clusters (mean position and size, accumulated confidence) in the order they were started
+	// returns the amount written
+	int get(float *rs, float *cs, float *ss, float *qs, int maxndetections) const;
+
+private:
+	struct Cluster
+	{
+		float sumr, sumc, sums, sumq;
+		int n;  // 0 once merged into another cluster
+	};
+
+	std::vector<Cluster> clusters;
+	std::vector<int> active;  // clusters new detections can still overlap
+	float lasts;
+	int nclusters;
+};
+
+// same as find_objects, but the detections are merged into clusters while scanning,
+// so none are dropped because of a full buffer; returns clusters.size()
+// the clusters are cleared first, so the same object can be passed for every frame
+int find_objects(DetectionClusters &clusters,
+	int (*detection_func)(float*, int, int, int, const uint8_t*, int, int, int),
+	const uint8_t *pixels, int nrows, int ncols, int ldim,
+	float scalefactor, float stridefactor, float minsize, float maxsize);
+
 int cluster_detections(float *rs, float *cs, float *ss, float *qs, int n);
 
+// detector for video, which keeps the objects found in the previous frame: the windows around them
+// (centres within margin*s of theirs, sizes within a factor of sizemargin of theirs) are classified in
+// every frame, while the full scan is spread over nframes frames (a band of rows of every scale per frame)
+// to pick up new objects; the first frame, and every frame after a reset or a change of the scan
+// parameters, is scanned fully
+// so apart from the share of the full scan, the cost of a frame follows the amount of objects
+class VideoDetector
+{
+public:
+	VideoDetector();
+
+	// only the clusters with a detection quality of at least minquality are kept as objects
+	void configure(int nframes, float margin, float sizemargin, float minquality);
+
+	// forgets the objects, the next frame is scanned fully
+	void reset();
+
+	// writes the clustered detections of the next frame, same parameters as find_objects
+	int detect(float *rs, float *cs, float *ss, float *qs, int maxndetections,
+		int (*detection_func)(float*, int, int, int, const uint8_t*, int, int, int),
+		const uint8_t *pixels, int nrows, int ncols, int ldim,
+		float scalefactor, float stridefactor, float minsize, float maxsize);
+
+	// amount of windows classified in the last frame
+	int nwindows() const { return nclassified; }
+
+private:
+	struct Scale
+	{
+		float s;
+		std::vector<float> rows;  // window centres, the same ones find_objects visits
+		std::vector<float> cols;
+	};
+
+	int nframes;
+	float margin;
+	float sizemargin;
+	float minquality;
+
+	int nrows, ncols;
+	float scalefactor, stridefactor, minsize, maxsize;
+	std::vector<Scale> scales;
+
+	int frame;  // frames since the last reset
+	int nclassified;
+	std::vector<float> objects;  // (r, c, s) triples
+	std::vector<float> dets[4];  // detections of the current frame, rs, cs, ss and qs
+};
+
+// find_objects for fixed cameras: the frame is compared with a reference in blocks of MOTION_BLOCK_SIZE
+// pixels, and the windows that only cover unchanged blocks are not classified again, their results
+// are taken from the previous frame; the reference of a block is updated when it changes
+// the binary tests are assumed to stay inside the window (as with cascades learned by picolrn)
+#define MOTION_BLOCK_SIZE 16
+class MotionGate
+{
+public:
+	MotionGate();
+
+	// a block has changed when the mean absolute difference of its pixels from the reference exceeds
+	// threshold (with 0, any change counts and the detections are exactly those of find_objects);
+	// every refresh frames all the windows are classified again (never if refresh <= 0)
+	void configure(float threshold, int refresh);
+
+	// the next frame is scanned fully
+	void reset();
+
+	// same as find_objects, the detections come in the same order
+	int detect(float *rs, float *cs, float *ss, float *qs, int maxndetections,
+		int (*detection_func)(float*, int, int, int, const uint8_t*, int, int, int),
+		const uint8_t *pixels, int nrows, int ncols, int ldim,
+		float scalefactor, float stridefactor, float minsize, float maxsize);
+
+	// share of the blocks that changed and amount of windows classified in the last frame
+	float changed() const { return nbrows > 0 && nbcols > 0 ? nchanged/(float)(nbrows*nbcols) : 0.0f; }
+	int nwindows() const { return nclassified; }
+
+private:
+	void update_blocks(const uint8_t *pixels, int ldim, bool all);
+
+	float threshold;
+	int refresh;
+
+	int nrows, ncols;
+	int nbrows, nbcols;
+	std::vector<uint8_t> reference;  // nrows x ncols
+	std::vector<int> changes;  // integral image of the changed blocks, (nbrows+1) x (nbcols+1)
+	float scalefactor, stridefactor, minsize, maxsize;
+
+	int frame;  // frames since the last full scan
+	bool complete;  // whether the detections of the last frame were not cut at maxndetections
+	std::vector<float> dets[4];  // detections of the last frame, rs, cs, ss and qs
+	std::vector<float> prev[4];
+
+	int nchanged;
+	int nclassified;
+};
+
+// find_objects for frames of which the changed rectangles are already known (screen capture, UI automation):
+// only the windows overlapping a dirty rectangle are classified again, the detections of the others
+// are taken from the previous frame; the first frame, and every frame after a reset, a change of the
+// scan parameters or a scan cut at maxndetections, is scanned fully
+// the binary tests are assumed to stay inside the window (as with cascades learned by picolrn)
+class IncrementalDetector
+{
+public:
+	IncrementalDetector();
+
+	// the next frame is scanned fully
+	void reset();
+
+	// same as find_objects, the detections come in the same order
+	// rects holds nrects (row, col, nrows, ncols) quadruples, the rectangles that changed since the last call
+	int detect(float *rs, float *cs, float *ss, float *qs, int maxndetections,
+		int (*detection_func)(float*, int, int, int, const uint8_t*, int, int, int),
+		const uint8_t *pixels, int nrows, int ncols, int ldim,
+		const int *rects, int nrects,
+		float scalefactor, float stridefactor, float minsize, float maxsize);
+
+	// amount of windows classified in the last frame
+	int nwindows() const { return nclassified; }
+
+private:
+	struct Scale
+	{
+		float s;
+		std::vector<float> rows;  // window centres, the same ones find_objects visits
+		std::vector<float> cols;
+	};
+
+	int nrows, ncols;
+	float scalefactor, stridefactor, minsize, maxsize;
+	std::vector<Scale> scales;
+
+	bool complete;  // whether the detections of the last frame were not cut at maxndetections
+	std::vector<int> windows[2];  // (scale, row, col) indices of the detections of the last frame, and scratch
+	std::vector<float> qualities[2];
+
+	int nclassified;
+};
+
+// one image of a find_objects_batch call, with its own range of object sizes
+struct BatchImage
+{
+	const uint8_t *pixels;
+	int nrows;
+	int ncols;
+	int ldim;
+	float minsize;
+	float maxsize;
+};
+
+// detections of a batch by image, all in one buffer that is kept (and only grows) across batches
+class BatchDetections
+{
+public:
+	// lays out room for counts[i] detections of image i, the amounts are set to the same values
+	void reset(const int *counts, int nimages);
+
+	int size() const { return (int)starts.size(); }
+
+	int ndetections(int image) const { return counts[image]; }
+	void set_ndetections(int image, int n) { counts[image] = n; }
+
+	float *rs(int image) { return arena.data() + starts[image]; }
+	float *cs(int image) { return arena.data() + starts[image] + capacities[image]; }
+	float *ss(int image) { return arena.data() + starts[image] + 2*capacities[image]; }
+	float *qs(int image) { return arena.data() + starts[image] + 3*capacities[image]; }
+	const float *rs(int image) const { return arena.data() + starts[image]; }
+	const float *cs(int image) const { return arena.data() + starts[image] + capacities[image]; }
+	const float *ss(int image) const { return arena.data() + starts[image] + 2*capacities[image]; }
+	const float *qs(int image) const { return arena.data() + starts[image] + 3*capacities[image]; }
+
+private:
+	std::vector<float> arena;
+	std::vector<size_t> starts;
+	std::vector<int> capacities;
+	std::vector<int> counts;
+};
+
+// many small images copied into one buffer, each one surrounded by guard pixels (of value 0)
+// so that it can be scanned with a single find_objects call; keep it across batches to reuse the buffer
+class ImageAtlas
+{
+public:
+	ImageAtlas();
+
+	// places the images in shelves of at most width pixels (a roughly square atlas if width <= 0)
+	void pack(const BatchImage *images, int nimages, int guard, int width);
+
+	const uint8_t *pixels() const { return &buffer[0]; }
+	int nrows() const { return rows; }
+	int ncols() const { return cols; }
+	int ldim() const { return cols; }
+
+	// finds the image holding the window of size s at (r, c) of the atlas, binary tests of cascade included
+	// returns false for windows that reach outside of an image, otherwise sets the index of the image
+	// and the position of the window in it
+	bool find(float r, float c, float s, const CascadeTables &cascade, int *image, float *ir, float *ic) const;
+
+private:
+	struct Slot
+	{
+		int row, col;
+		int nrows, ncols;
+	};
+
+	struct Shelf
+	{
+		int row;
+		int slot0, slot1;  // its slots, left to right
+	};
+
+	std::vector<Slot> slots;
+	std::vector<Shelf> shelves;
+	std::vector<int> rowshelves;  // shelf of every row of the atlas
+	std::vector<int> shelfslots;  // slot of every column of every shelf
+	std::vector<uint8_t> buffer;
+	int rows, cols;
+};
+
+// find_objects with cascade tables for many small images at once: they are packed into the atlas with
+// guard bands as wide as the binary tests of the largest window reach, the atlas is scanned once
+// and the detections inside an image (and within its size range) are moved back to it,
+// with the index of the image written to indices
+// the windows come from the scan of the atlas, which starts at a different place than the scan
+// of every image, so the detections are close to, but not the same as, those of find_objects
+int find_objects_atlas(float *rs, float *cs, float *ss, float *qs, int *indices, int maxndetections,
+	ImageAtlas &atlas, const CascadeTables &cascade,
+	const BatchImage *images, int nimages,
+	float scalefactor, float stridefactor);
+
+// find_objects (followed by cluster_detections if cluster is set) for many images at once:
+// the windows of all the images are split into tasks of similar size, several small images
+// sharing one, which are run on the threads of pool
+// every image keeps at most maxndetections detections, the same ones and in the same order
+// as find_objects would give; returns the amount of detections of the whole batch
+// detection_func must be safe to call from several threads at once
+int find_objects_batch(BatchDetections &detections, int maxndetections,
+	int (*detection_func)(float*, int, int, int, const uint8_t*, int, int, int),
+	const BatchImage *images, int nimages,
+	float scalefactor, float stridefactor, bool cluster, WorkStealingPool &pool);
+
 #endif  // PICORNT_H
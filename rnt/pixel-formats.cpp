@@ -0,0 +1,123 @@
+#include "picornt.h"
+
+#include <algorithm>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+// luma weights of OpenCV's RGB to gray conversion, in 1/2^LUMA_SHIFT
+#define LUMA_R 4899
+#define LUMA_G 9617
+#define LUMA_B 1868
+#define LUMA_SHIFT 14
+
+// packed pixels are converted to luma this many rows at a time
+#define LUMA_BAND_ROWS 16
+
+// converts n packed pixels of bpp bytes to luma, w0 and w2 are the weights of their first and third bytes
+typedef void (*luma_converter)(uint8_t *dst, const uint8_t *src, int n, int bpp, int w0, int w2);
+
+static void convert_row_scalar(uint8_t *dst, const uint8_t *src, int n, int bpp, int w0, int w2)
+{
+	for (int c = 0; c < n; ++c, src += bpp)
+		dst[c] = (uint8_t)((w0*src[0] + LUMA_G*src[1] + w2*src[2] + (1<<(LUMA_SHIFT-1))) >> LUMA_SHIFT);
+}
+
+#ifdef HAVE_X86_SIMD
+
+// luma of the 4 pixels in v, the shuffles put the bytes of pixels 0 and 1 (lo) and 2 and 3 (hi)
+// into 16-bit lanes as (first, second, third, 0)
+__attribute__((target("ssse3")))
+static inline __m128i get_luma4(__m128i v, __m128i lo, __m128i hi, __m128i weights)
+{
+	// sums of the first two and of the last two weighted bytes of every pixel
+	__m128 m0 = _mm_castsi128_ps(_mm_madd_epi16(_mm_shuffle_epi8(v, lo), weights));
+	__m128 m1 = _mm_castsi128_ps(_mm_madd_epi16(_mm_shuffle_epi8(v, hi), weights));
+
+	__m128i a = _mm_castps_si128(_mm_shuffle_ps(m0, m1, _MM_SHUFFLE(2, 0, 2, 0)));
+	__m128i b = _mm_castps_si128(_mm_shuffle_ps(m0, m1, _MM_SHUFFLE(3, 1, 3, 1)));
+
+	return _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(a, b), _mm_set1_epi32(1<<(LUMA_SHIFT-1))), LUMA_SHIFT);
+}
+
+__attribute__((target("ssse3")))
+static void convert_row_ssse3(uint8_t *dst, const uint8_t *src, int n, int bpp, int w0, int w2)
+{
+	const __m128i weights = _mm_setr_epi16(w0, LUMA_G, w2, 0, w0, LUMA_G, w2, 0);
+	const __m128i lo = bpp == 3 ?
+		_mm_setr_epi8(0, -1, 1, -1, 2, -1, -1, -1, 3, -1, 4, -1, 5, -1, -1, -1) :
+		_mm_setr_epi8(0, -1, 1, -1, 2, -1, -1, -1, 4, -1, 5, -1, 6, -1, -1, -1);
+	const __m128i hi = bpp == 3 ?
+		_mm_setr_epi8(6, -1, 7, -1, 8, -1, -1, -1, 9, -1, 10, -1, 11, -1, -1, -1) :
+		_mm_setr_epi8(8, -1, 9, -1, 10, -1, -1, -1, 12, -1, 13, -1, 14, -1, -1, -1);
+
+	// 8 pixels per step, in two 16-byte loads that must not go past the end of the row
+	int c = 0;
+	for (; (c+4)*bpp + 16 <= n*bpp; c += 8)
+	{
+		__m128i y0 = get_luma4(_mm_loadu_si128((const __m128i*)&src[c*bpp]), lo, hi, weights);
+		__m128i y1 = get_luma4(_mm_loadu_si128((const __m128i*)&src[(c+4)*bpp]), lo, hi, weights);
+
+		_mm_storel_epi64((__m128i*)&dst[c], _mm_packus_epi16(_mm_packs_epi32(y0, y1), _mm_setzero_si128()));
+	}
+
+	convert_row_scalar(&dst[c], &src[c*bpp], n - c, bpp, w0, w2);
+}
+
+#endif // HAVE_X86_SIMD
+
+static luma_converter get_luma_converter()
+{
+#ifdef HAVE_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("ssse3"))
+		return convert_row_ssse3;
+#endif
+	return convert_row_scalar;
+}
+
+int find_objects(float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	StreamingDetector &detector, const CascadeTables &cascade,
+	int format, const uint8_t *data, int nrows, int ncols, int ldim,
+	float scalefactor, float stridefactor, float minsize, float maxsize)
+{
+	int bpp, w0, w2;
+	switch (format)
+	{
+		case PIXEL_FORMAT_GRAY:
+		case PIXEL_FORMAT_NV12:
+		case PIXEL_FORMAT_I420:
+			// the Y plane comes first and it is a gray image, the chroma is not needed
+			return find_objects(rs, cs, ss, qs, maxndetections, cascade, data, nrows, ncols, ldim,
+				scalefactor, stridefactor, minsize, maxsize);
+		case PIXEL_FORMAT_RGB24: bpp = 3; w0 = LUMA_R; w2 = LUMA_B; break;
+		case PIXEL_FORMAT_BGR24: bpp = 3; w0 = LUMA_B; w2 = LUMA_R; break;
+		case PIXEL_FORMAT_BGRA: bpp = 4; w0 = LUMA_B; w2 = LUMA_R; break;
+		default: return 0;
+	}
+
+	static const luma_converter convert = get_luma_converter();
+
+	// the rows are converted in bands just before the scan needs them,
+	// and the ones after the last window are not converted at all
+	// (the band is kept in the detector, so that it is only allocated for the first frame of a size)
+	std::vector<uint8_t> &band = detector.band;
+	band.resize((size_t)LUMA_BAND_ROWS*ncols);
+	detector.start(cascade, nrows, ncols, scalefactor, stridefactor, minsize, maxsize);
+
+	int ndetections = 0;
+	for (int r = 0; r < nrows && !detector.done() && ndetections < maxndetections; r += LUMA_BAND_ROWS)
+	{
+		const int n = std::min(LUMA_BAND_ROWS, nrows - r);
+		for (int k = 0; k < n; ++k)
+			convert(&band[(size_t)k*ncols], &data[(size_t)(r+k)*ldim], ncols, bpp, w0, w2);
+
+		ndetections += detector.push(&rs[ndetections], &cs[ndetections], &ss[ndetections], &qs[ndetections],
+			maxndetections - ndetections, &band[0], n, ncols);
+	}
+
+	return ndetections;
+}
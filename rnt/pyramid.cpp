@@ -0,0 +1,136 @@
+#include "picornt.h"
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+// rows of the levels start at multiples of this many bytes
+#define PYRAMID_ALIGNMENT 16
+
+// dst[r][c] = the rounded average of the 2x2 block src[2r..2r+1][2c..2c+1]
+static void downsample_row(uint8_t *dst, const uint8_t *src0, const uint8_t *src1, int ncols)
+{
+	int c = 0;
+
+#ifdef HAVE_SSE2
+	const __m128i mask = _mm_set1_epi16(0x00FF);
+	const __m128i two = _mm_set1_epi16(2);
+
+	// 32 source pixels per row give 16 destination pixels
+	for (; c + 16 <= ncols; c += 16)
+	{
+		__m128i a0 = _mm_loadu_si128((const __m128i*)&src0[2*c]);
+		__m128i a1 = _mm_loadu_si128((const __m128i*)&src0[2*c+16]);
+		__m128i b0 = _mm_loadu_si128((const __m128i*)&src1[2*c]);
+		__m128i b1 = _mm_loadu_si128((const __m128i*)&src1[2*c+16]);
+
+		// sums of horizontal pairs as 16-bit values
+		__m128i s0 = _mm_add_epi16(
+			_mm_add_epi16(_mm_and_si128(a0, mask), _mm_srli_epi16(a0, 8)),
+			_mm_add_epi16(_mm_and_si128(b0, mask), _mm_srli_epi16(b0, 8)));
+		__m128i s1 = _mm_add_epi16(
+			_mm_add_epi16(_mm_and_si128(a1, mask), _mm_srli_epi16(a1, 8)),
+			_mm_add_epi16(_mm_and_si128(b1, mask), _mm_srli_epi16(b1, 8)));
+
+		s0 = _mm_srli_epi16(_mm_add_epi16(s0, two), 2);
+		s1 = _mm_srli_epi16(_mm_add_epi16(s1, two), 2);
+
+		_mm_storeu_si128((__m128i*)&dst[c], _mm_packus_epi16(s0, s1));
+	}
+#endif
+
+	for (; c < ncols; ++c)
+		dst[c] = (src0[2*c] + src0[2*c+1] + src1[2*c] + src1[2*c+1] + 2) >> 2;
+}
+
+ImagePyramid::ImagePyramid()
+{}
+
+void ImagePyramid::build(const uint8_t *pixels, int nrows, int ncols, int ldim, int nlevels)
+{
+	levels.resize(std::max(1, nlevels));
+
+	levels[0].pixels = pixels;
+	levels[0].nrows = nrows;
+	levels[0].ncols = ncols;
+	levels[0].ldim = ldim;
+
+	// all the other levels share one buffer, which only grows
+	size_t size = 0;
+	for (size_t i = 1; i < levels.size(); ++i)
+	{
+		nrows /= 2;
+		ncols /= 2;
+		ldim = (ncols + PYRAMID_ALIGNMENT-1)/PYRAMID_ALIGNMENT*PYRAMID_ALIGNMENT;
+
+		levels[i].nrows = nrows;
+		levels[i].ncols = ncols;
+		levels[i].ldim = ldim;
+		size += (size_t)nrows*ldim;
+	}
+
+	if (buffer.size() < size + PYRAMID_ALIGNMENT)
+		buffer.resize(size + PYRAMID_ALIGNMENT);
+
+	uint8_t *p = &buffer[0];
+	p += (PYRAMID_ALIGNMENT - (uintptr_t)p%PYRAMID_ALIGNMENT)%PYRAMID_ALIGNMENT;
+
+	for (size_t i = 1; i < levels.size(); ++i)
+	{
+		Level &prev = levels[i-1];
+		Level &level = levels[i];
+
+		level.pixels = p;
+		for (int r = 0; r < level.nrows; ++r)
+			downsample_row(&p[r*level.ldim],
+				&prev.pixels[(2*r+0)*prev.ldim], &prev.pixels[(2*r+1)*prev.ldim], level.ncols);
+
+		p += (size_t)level.nrows*level.ldim;
+	}
+}
+
+int find_objects_pyramid(float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	int (*detection_func)(float*, int, int, int, const uint8_t*, int, int, int),
+	ImagePyramid &pyramid, int nlevels, float maxlevelsize,
+	const uint8_t *pixels, int nrows, int ncols, int ldim,
+	float scalefactor, float stridefactor, float minsize, float maxsize)
+{
+	pyramid.build(pixels, nrows, ncols, ldim, nlevels);
+
+	int ndetections = 0;
+	float s = minsize;
+	for (int i = 0; i < pyramid.size() && s <= maxsize; ++i)
+	{
+		const float f = (float)(1<<i);
+
+		if (i < pyramid.size()-1 && s/f > maxlevelsize)
+			continue;
+
+		// sizes of this level: the ones up to maxlevelsize (in level pixels), all that are left on the last one
+		// dividing by a power of two is exact, so the level visits the same sizes as a full-resolution scan would
+		float lastsize = s;
+		while (lastsize*scalefactor <= maxsize && (i == pyramid.size()-1 || lastsize*scalefactor/f <= maxlevelsize))
+			lastsize *= scalefactor;
+
+		int n = find_objects(&rs[ndetections], &cs[ndetections], &ss[ndetections], &qs[ndetections], maxndetections-ndetections,
+			detection_func,
+			pyramid.pixels(i), pyramid.nrows(i), pyramid.ncols(i), pyramid.ldim(i),
+			scalefactor, stridefactor, s/f, lastsize/f);
+
+		// pixel k of level i covers full-resolution pixels k*f to k*f + f-1
+		for (int j = ndetections; j < ndetections + n; ++j)
+		{
+			rs[j] = f*rs[j] + (f-1)/2;
+			cs[j] = f*cs[j] + (f-1)/2;
+			ss[j] = f*ss[j];
+		}
+		ndetections += n;
+
+		s = lastsize*scalefactor;
+	}
+
+	return ndetections;
+}
@@ -0,0 +1,125 @@
+#include "picornt.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+// generations of all the RuntimeCascade objects come from one counter, so that an object created where
+// another one was destroyed does not repeat its generations
+static int next_generation()
+{
+	static std::atomic<int> counter(0);
+
+	return ++counter;
+}
+
+RuntimeCascade::RuntimeCascade()
+{
+	data.tsr = 1.0f;
+	data.tsc = 1.0f;
+	data.tdepth = 0;
+	data.ntrees = 0;
+	data.maxr = 0;
+	data.maxc = 0;
+	data.tcodes = 0;
+	data.luts = 0;
+	data.thresholds = 0;
+	data.generation = next_generation();
+}
+
+bool RuntimeCascade::load(const char *path, double rotation, double threshold_shift)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return false;
+
+	float tsr, tsc;
+	int tdepth, ntrees;
+	if (fread(&tsr, sizeof(float), 1, file) != 1 ||
+		fread(&tsc, sizeof(float), 1, file) != 1 ||
+		fread(&tdepth, sizeof(int), 1, file) != 1 ||
+		fread(&ntrees, sizeof(int), 1, file) != 1 ||
+		tdepth < 1 || tdepth > 10 || ntrees < 1)
+	{
+		fclose(file);
+		return false;
+	}
+
+	const int nnodes = 1<<tdepth;
+
+	std::vector<int32_t> codes(nnodes - 1);
+	std::vector<int16_t> new_tcodes(4*ntrees*nnodes);
+	std::vector<float> new_luts(ntrees*nnodes);
+	std::vector<float> new_thresholds(ntrees);
+
+	// rotate the binary tests the same way picogen does
+	int q = (1<<16);
+	int qsin = (int)( q*sin(rotation) );
+	int qcos = (int)( q*cos(rotation) );
+
+	int maxr = 0;
+	int maxc = 0;
+
+	for (int i = 0; i < ntrees; ++i)
+	{
+		if (fread(&codes[0], sizeof(int32_t), nnodes-1, file) != size_t(nnodes-1) ||
+			fread(&new_luts[i*nnodes], sizeof(float), nnodes, file) != size_t(nnodes) ||
+			fread(&new_thresholds[i], sizeof(float), 1, file) != 1)
+		{
+			fclose(file);
+			return false;
+		}
+
+		if (threshold_shift)
+			new_thresholds[i] -= fabs(new_thresholds[i]) * threshold_shift * i / float(ntrees);
+
+		// node indices start from 1
+		int16_t *t = &new_tcodes[4*i*nnodes];
+		for (int j = 0; j < nnodes - 1; ++j)
+		{
+			int8_t* p = (int8_t*)&codes[j];
+			int16_t* rt = &t[4*(j+1)];
+
+			rt[0] = (p[0]*qcos - p[1]*qsin)/q;
+			rt[1] = (p[0]*qsin + p[1]*qcos)/q;
+
+			rt[2] = (p[2]*qcos - p[3]*qsin)/q;
+			rt[3] = (p[2]*qsin + p[3]*qcos)/q;
+
+			maxr = std::max(maxr, std::max(std::abs(int(rt[0])), std::abs(int(rt[2]))));
+			maxc = std::max(maxc, std::max(std::abs(int(rt[1])), std::abs(int(rt[3]))));
+		}
+	}
+
+	fclose(file);
+
+	tcodes.swap(new_tcodes);
+	luts.swap(new_luts);
+	thresholds.swap(new_thresholds);
+
+	data.tsr = tsr;
+	data.tsc = tsc;
+	data.tdepth = tdepth;
+	data.ntrees = ntrees;
+	data.maxr = maxr;
+	data.maxc = maxc;
+	data.tcodes = (const int16_t (*)[4])&tcodes[0];
+	data.luts = &luts[0];
+	data.thresholds = &thresholds[0];
+
+	// so that the scan plans and compiled code of the previous model get rebuilt
+	data.generation = next_generation();
+
+	return true;
+}
+
+int RuntimeCascade::classify(float *o, int r, int c, int s,
+	const uint8_t *pixels, int nrows, int ncols, int ldim) const
+{
+	if (empty())
+		return -1;
+
+	return classify_window(data, o, r, c, s, pixels, nrows, ncols, ldim);
+}
@@ -0,0 +1,113 @@
+/*
+	Compares find_objects_atlas with one find_objects call per image on many small images.
+
+		$ ./atlas-benchmark CASCADE [NIMAGES [SIZE [MINSIZE]]]
+
+	The images are SIZExSIZE crops of a synthetic (smooth, noisy) texture, scanned for objects from MINSIZE to SIZE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <vector>
+
+#include "../picornt.h"
+
+static double get_time()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+// blurred noise, so that the cascade does not reject every window at its first tree
+static void make_texture(std::vector<uint8_t> &pixels, int nrows, int ncols)
+{
+	std::vector<int> noise(nrows*ncols);
+	for (int i = 0; i < nrows*ncols; ++i)
+		noise[i] = rand()%256;
+
+	pixels.resize(nrows*ncols);
+	for (int r = 0; r < nrows; ++r)
+		for (int c = 0; c < ncols; ++c)
+		{
+			int sum = 0, n = 0;
+			for (int i = r-2; i <= r+2; ++i)
+				for (int j = c-2; j <= c+2; ++j)
+					if (i >= 0 && i < nrows && j >= 0 && j < ncols)
+					{
+						sum += noise[i*ncols + j];
+						++n;
+					}
+			pixels[r*ncols + c] = sum/n;
+		}
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2)
+	{
+		printf("usage: %s CASCADE [NIMAGES [SIZE [MINSIZE]]]\n", argv[0]);
+		return 1;
+	}
+
+	RuntimeCascade cascade;
+	if (!cascade.load(argv[1]))
+	{
+		printf("cannot load %s\n", argv[1]);
+		return 1;
+	}
+
+	const int nimages = argc > 2 ? atoi(argv[2]) : 4096;
+	const int size = argc > 3 ? atoi(argv[3]) : 64;
+	const float minsize = argc > 4 ? atof(argv[4]) : 24.0f;
+	const float scalefactor = 1.1f;
+	const float stridefactor = 0.1f;
+
+	// the crops are taken from one texture
+	const int texturesize = 1024;
+	std::vector<uint8_t> texture;
+	make_texture(texture, texturesize, texturesize);
+
+	std::vector<BatchImage> images(nimages);
+	for (int i = 0; i < nimages; ++i)
+	{
+		const int r = rand()%(texturesize - size);
+		const int c = rand()%(texturesize - size);
+		BatchImage image = {&texture[r*texturesize + c], size, size, texturesize, minsize, (float)size};
+		images[i] = image;
+	}
+
+	const int maxndetections = 1000000;
+	std::vector<float> rs(maxndetections), cs(maxndetections), ss(maxndetections), qs(maxndetections);
+	std::vector<int> indices(maxndetections);
+
+	// one call per image
+	double t = get_time();
+	int n1 = 0;
+	for (int i = 0; i < nimages; ++i)
+		n1 += find_objects(&rs[0], &cs[0], &ss[0], &qs[0], maxndetections,
+			cascade.tables(),
+			images[i].pixels, images[i].nrows, images[i].ncols, images[i].ldim,
+			scalefactor, stridefactor, images[i].minsize, images[i].maxsize);
+	const double t1 = get_time() - t;
+
+	// one call for all of them (the second run reuses the atlas buffer)
+	ImageAtlas atlas;
+	find_objects_atlas(&rs[0], &cs[0], &ss[0], &qs[0], &indices[0], maxndetections,
+		atlas, cascade.tables(), &images[0], nimages, scalefactor, stridefactor);
+
+	t = get_time();
+	int n2 = find_objects_atlas(&rs[0], &cs[0], &ss[0], &qs[0], &indices[0], maxndetections,
+		atlas, cascade.tables(), &images[0], nimages, scalefactor, stridefactor);
+	const double t2 = get_time() - t;
+
+	printf("%d images of %dx%d, sizes %g to %d\n", nimages, size, size, minsize, size);
+	printf("per image: %8.2f ms (%6.2f us per image), %d detections\n", 1000*t1, 1e6*t1/nimages, n1);
+	printf("atlas:     %8.2f ms (%6.2f us per image), %d detections, %dx%d atlas\n",
+		1000*t2, 1e6*t2/nimages, n2, atlas.nrows(), atlas.ncols());
+
+	return 0;
+}
@@ -0,0 +1,156 @@
+/*
+	Compares find_objects_interleaved, for several amounts of interleaved windows, with the function generated
+	by picogen and with find_objects on a scan plan, on a 4K frame.
+
+		$ ./interleave-benchmark CASCADE [MINSIZE [IMAGE.pgm]]
+
+	The generated function is the face detector built into the runtime (cascades/face-cpu.h), so CASCADE
+	should be the facefinder it was generated from. Without an image, a 3840x2160 synthetic (smooth, noisy)
+	texture is scanned. Every time is the best of NRUNS runs.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "../picornt.h"
+
+// generated by picogen, compiled into the runtime library
+int facedet(float* o, int r, int c, int s, const uint8_t* pixels, int nrows, int ncols, int ldim);
+
+static double get_time()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+static bool load_pgm(const char *path, std::vector<uint8_t> &pixels, int *nrows, int *ncols)
+{
+	FILE *file = fopen(path, "rb");
+	if (!file)
+		return false;
+
+	int maxval;
+	if (fscanf(file, "P5 %d %d %d", ncols, nrows, &maxval) != 3 || maxval != 255)
+	{
+		fclose(file);
+		return false;
+	}
+	fgetc(file);
+
+	pixels.resize(*nrows * *ncols);
+	const bool ok = fread(&pixels[0], 1, pixels.size(), file) == pixels.size();
+	fclose(file);
+
+	return ok;
+}
+
+// blurred noise, so that the cascade does not reject every window at its first tree
+static void make_texture(std::vector<uint8_t> &pixels, int nrows, int ncols)
+{
+	std::vector<int> noise(nrows*ncols);
+	for (int i = 0; i < nrows*ncols; ++i)
+		noise[i] = rand()%256;
+
+	pixels.resize(nrows*ncols);
+	for (int r = 0; r < nrows; ++r)
+		for (int c = 0; c < ncols; ++c)
+		{
+			int sum = 0, n = 0;
+			for (int i = r-2; i <= r+2; ++i)
+				for (int j = c-2; j <= c+2; ++j)
+					if (i >= 0 && i < nrows && j >= 0 && j < ncols)
+					{
+						sum += noise[i*ncols + j];
+						++n;
+					}
+			pixels[r*ncols + c] = sum/n;
+		}
+}
+
+#define NRUNS 3
+#define MAXNDETECTIONS 1000000
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2)
+	{
+		printf("usage: %s CASCADE [MINSIZE [IMAGE.pgm]]\n", argv[0]);
+		return 1;
+	}
+
+	RuntimeCascade cascade;
+	if (!cascade.load(argv[1]))
+	{
+		printf("cannot load %s\n", argv[1]);
+		return 1;
+	}
+
+	const float minsize = argc > 2 ? atof(argv[2]) : 24.0f;
+	const float scalefactor = 1.1f;
+	const float stridefactor = 0.1f;
+
+	int nrows = 2160, ncols = 3840;
+	std::vector<uint8_t> pixels;
+	if (argc > 3)
+	{
+		if (!load_pgm(argv[3], pixels, &nrows, &ncols))
+		{
+			printf("cannot load %s\n", argv[3]);
+			return 1;
+		}
+	}
+	else
+		make_texture(pixels, nrows, ncols);
+
+	const float maxsize = 0.9f*std::min(nrows, ncols);
+
+	ScanPlan plan;
+	plan.prepare(cascade.tables(), nrows, ncols, ncols, scalefactor, stridefactor, minsize, maxsize);
+
+	std::vector<float> rs(MAXNDETECTIONS), cs(MAXNDETECTIONS), ss(MAXNDETECTIONS), qs(MAXNDETECTIONS);
+
+	printf("%dx%d, sizes %g to %g, stride %g\n", ncols, nrows, minsize, maxsize, stridefactor);
+
+	// method 0 is the generated function, 1 the plan, the rest interleaved with nwindows[k-2] windows
+	const int nmethods = 6;
+	const int nwindows[nmethods-2] = {1, 4, 8, 32};
+	double times[nmethods];
+	for (int k = 0; k < nmethods; ++k)
+	{
+		times[k] = 1e9;
+
+		int n = 0;
+		for (int run = 0; run < NRUNS; ++run)
+		{
+			double t = get_time();
+			if (k == 0)
+				n = find_objects(&rs[0], &cs[0], &ss[0], &qs[0], MAXNDETECTIONS,
+					facedet, &pixels[0], nrows, ncols, ncols,
+					scalefactor, stridefactor, minsize, maxsize);
+			else if (k == 1)
+				n = find_objects(&rs[0], &cs[0], &ss[0], &qs[0], MAXNDETECTIONS,
+					plan, &pixels[0]);
+			else
+				n = find_objects_interleaved(&rs[0], &cs[0], &ss[0], &qs[0], MAXNDETECTIONS,
+					plan, &pixels[0], nwindows[k-2]);
+			times[k] = std::min(times[k], get_time() - t);
+		}
+
+		char name[32];
+		if (k == 0)
+			snprintf(name, sizeof(name), "generated:");
+		else if (k == 1)
+			snprintf(name, sizeof(name), "plan:");
+		else
+			snprintf(name, sizeof(name), "interleaved K=%d:", nwindows[k-2]);
+		printf("%-18s %8.2f ms (%.2fx the generated function), %d detections\n", name, 1000*times[k], times[0]/times[k], n);
+	}
+
+	return 0;
+}
@@ -73,7 +73,7 @@ int maxsize = 1024;
 
 void process_image(IplImage* frame, int draw, int print)
 {
-	int i, j;
+	int i;
 	float t;
 
 	uint8_t* pixels;
@@ -84,7 +84,8 @@ void process_image(IplImage* frame, int draw, int print)
 	float qs[MAXNDETECTIONS], rs[MAXNDETECTIONS], cs[MAXNDETECTIONS], ss[MAXNDETECTIONS];
 
 	static IplImage* gray = 0;
-	static IplImage* pyr[5] = {0, 0, 0, 0, 0};
+	static ImagePyramid pyramid;
+	static VideoDetector video;
 
 	/*
 		IMPORTANT:
@@ -116,24 +117,19 @@ void process_image(IplImage* frame, int draw, int print)
 	// * set to 1 if pico fails to detect large objects
 	int usepyr = 0;
 
+	// * temporal tracking for video streams
+	// * most frames are only scanned around the faces found in the previous frame (and a tenth of the full scan)
+	// * set to 1 to speed up the webcam loop
+	int usetracking = 0;
+
 	/*
 		...
 	*/
 
 	//
-	if(!pyr[0])
-	{
-		//
+	if(!gray)
 		gray = cvCreateImage(cvSize(frame->width, frame->height), frame->depth, 1);
 
-		//
-		pyr[0] = gray;
-		pyr[1] = cvCreateImage(cvSize(frame->width/2, frame->height/2), frame->depth, 1);
-		pyr[2] = cvCreateImage(cvSize(frame->width/4, frame->height/4), frame->depth, 1);
-		pyr[3] = cvCreateImage(cvSize(frame->width/8, frame->height/8), frame->depth, 1);
-		pyr[4] = cvCreateImage(cvSize(frame->width/16, frame->height/16), frame->depth, 1);
-	}
-
 	// get grayscale image
 	if(frame->nChannels == 3)
 		cvCvtColor(frame, gray, CV_RGB2GRAY);
@@ -143,54 +139,31 @@ void process_image(IplImage* frame, int draw, int print)
 	// perform detection with the pico library
 	t = getticks();
 
-	if(usepyr)
-	{
-		int nd;
-
-		//
-		pyr[0] = gray;
-
-		pixels = (uint8_t*)pyr[0]->imageData;
-		nrows = pyr[0]->height;
-		ncols = pyr[0]->width;
-		ldim = pyr[0]->widthStep;
-
-		ndetections = find_objects(rs, cs, ss, qs, MAXNDETECTIONS, run_detection_cascade, pixels, nrows, ncols, ldim, scalefactor, stridefactor, MAX(16, minsize), MIN(128, maxsize));
-
-		for(i=1; i<5; ++i)
-		{
-			cvResize(pyr[i-1], pyr[i], CV_INTER_LINEAR);
-
-			pixels = (uint8_t*)pyr[i]->imageData;
-			nrows = pyr[i]->height;
-			ncols = pyr[i]->width;
-			ldim = pyr[i]->widthStep;
-
-			nd = find_objects(&rs[ndetections], &cs[ndetections], &ss[ndetections], &qs[ndetections], MAXNDETECTIONS-ndetections, run_detection_cascade, pixels, nrows, ncols, ldim, scalefactor, stridefactor, MAX(64, minsize>>i), MIN(128, maxsize>>i));
-
-			for(j=ndetections; j<ndetections+nd; ++j)
-			{
-				rs[j] = (1<<i)*rs[j];
-				cs[j] = (1<<i)*cs[j];
-				ss[j] = (1<<i)*ss[j];
-			}
+	//
+	pixels = (uint8_t*)gray->imageData;
+	nrows = gray->height;
+	ncols = gray->width;
+	ldim = gray->widthStep;
 
-			ndetections = ndetections + nd;
-		}
+	if(usetracking)
+	{
+		// keeps the faces with a detection quality above the threshold, and clusters the detections itself
+		video.configure(10, 0.5f, 1.3f, qthreshold);
+		ndetections = video.detect(rs, cs, ss, qs, MAXNDETECTIONS, run_detection_cascade, pixels, nrows, ncols, ldim, scalefactor, stridefactor, minsize, MIN(nrows, ncols));
+	}
+	else if(usepyr)
+	{
+		// five levels, windows larger than 128 pixels are scanned on a downsampled level
+		ndetections = find_objects_pyramid(rs, cs, ss, qs, MAXNDETECTIONS, run_detection_cascade, pyramid, 5, 128, pixels, nrows, ncols, ldim, scalefactor, stridefactor, minsize, MIN(maxsize, MIN(nrows, ncols)));
 	}
 	else
 	{
-		//
-		pixels = (uint8_t*)gray->imageData;
-		nrows = gray->height;
-		ncols = gray->width;
-		ldim = gray->widthStep;
-
 		//
 		ndetections = find_objects(rs, cs, ss, qs, MAXNDETECTIONS, run_detection_cascade, pixels, nrows, ncols, ldim, scalefactor, stridefactor, minsize, MIN(nrows, ncols));
 	}
 
-	ndetections = cluster_detections(rs, cs, ss, qs, ndetections);
+	if(!usetracking)
+		ndetections = cluster_detections(rs, cs, ss, qs, ndetections);
 
 	t = getticks() - t;
 
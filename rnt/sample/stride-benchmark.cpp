@@ -0,0 +1,178 @@
+/*
+	Compares find_objects_adaptive, for several skip schedules, with the dense scan of find_objects on a set of images.
+
+		$ ./stride-benchmark CASCADE MINSIZE IMAGE.pgm [IMAGE.pgm ...]
+
+	The images are binary (P5) PGM files. The recall of a schedule is the share of the clusters of the dense scan
+	(with a quality of at least 5) that have a cluster of the adaptive scan of about the same position and size.
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "../picornt.h"
+
+static double get_time()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+static bool load_pgm(const char *path, std::vector<uint8_t> &pixels, int *nrows, int *ncols)
+{
+	FILE *file = fopen(path, "rb");
+	if (!file)
+		return false;
+
+	int maxval;
+	if (fscanf(file, "P5 %d %d %d", ncols, nrows, &maxval) != 3 || maxval != 255)
+	{
+		fclose(file);
+		return false;
+	}
+	fgetc(file);
+
+	pixels.resize(*nrows * *ncols);
+	const bool ok = fread(&pixels[0], 1, pixels.size(), file) == pixels.size();
+	fclose(file);
+
+	return ok;
+}
+
+#define MAXNDETECTIONS 65536
+#define MINQUALITY 5.0f
+
+struct Detections
+{
+	std::vector<float> rs, cs, ss, qs;
+	int n;
+
+	Detections() : rs(MAXNDETECTIONS), cs(MAXNDETECTIONS), ss(MAXNDETECTIONS), qs(MAXNDETECTIONS), n(0) {}
+
+	// clusters the detections and keeps the strong ones
+	void finish()
+	{
+		n = cluster_detections(&rs[0], &cs[0], &ss[0], &qs[0], n);
+
+		int m = 0;
+		for (int i = 0; i < n; ++i)
+			if (qs[i] >= MINQUALITY)
+			{
+				rs[m] = rs[i];
+				cs[m] = cs[i];
+				ss[m] = ss[i];
+				qs[m] = qs[i];
+				++m;
+			}
+		n = m;
+	}
+};
+
+// amount of the reference clusters found in dets
+static int get_nmatched(const Detections &reference, const Detections &dets)
+{
+	int nmatched = 0;
+	for (int i = 0; i < reference.n; ++i)
+		for (int j = 0; j < dets.n; ++j)
+			if (fabs(reference.rs[i] - dets.rs[j]) < 0.3f*reference.ss[i] &&
+				fabs(reference.cs[i] - dets.cs[j]) < 0.3f*reference.ss[i] &&
+				fabs(reference.ss[i]/dets.ss[j] - 1.0f) < 0.3f)
+			{
+				++nmatched;
+				break;
+			}
+
+	return nmatched;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 4)
+	{
+		printf("usage: %s CASCADE MINSIZE IMAGE.pgm [IMAGE.pgm ...]\n", argv[0]);
+		return 1;
+	}
+
+	RuntimeCascade cascade;
+	if (!cascade.load(argv[1]))
+	{
+		printf("cannot load %s\n", argv[1]);
+		return 1;
+	}
+
+	const float minsize = atof(argv[2]);
+	const float scalefactor = 1.1f;
+	const float stridefactor = 0.1f;
+
+	// skips after a rejection by the first, second, third, ... tree
+	const int nschedules = 6;
+	const int nskips = 3;
+	const int schedules[nschedules][nskips] =
+	{
+		{0, 0, 0},
+		{1, 0, 0},
+		{2, 1, 0},
+		{3, 2, 1},
+		{4, 2, 1},
+		{6, 3, 1},
+	};
+
+	double times[nschedules+1] = {0};
+	int nmatched[nschedules] = {0};
+	int nreference = 0;
+	int nimages = 0;
+
+	ScanPlan plan;
+	Detections reference, dets;
+	std::vector<uint8_t> pixels;
+	for (int i = 3; i < argc; ++i)
+	{
+		int nrows, ncols;
+		if (!load_pgm(argv[i], pixels, &nrows, &ncols))
+		{
+			printf("cannot load %s\n", argv[i]);
+			continue;
+		}
+		++nimages;
+
+		plan.prepare(cascade.tables(), nrows, ncols, ncols, scalefactor, stridefactor, minsize, 0.9f*std::min(nrows, ncols));
+
+		double t = get_time();
+		reference.n = find_objects(&reference.rs[0], &reference.cs[0], &reference.ss[0], &reference.qs[0], MAXNDETECTIONS,
+			plan, &pixels[0]);
+		times[nschedules] += get_time() - t;
+
+		reference.finish();
+		nreference += reference.n;
+
+		for (int k = 0; k < nschedules; ++k)
+		{
+			t = get_time();
+			dets.n = find_objects_adaptive(&dets.rs[0], &dets.cs[0], &dets.ss[0], &dets.qs[0], MAXNDETECTIONS,
+				plan, &pixels[0], schedules[k], nskips);
+			times[k] += get_time() - t;
+
+			dets.finish();
+			nmatched[k] += get_nmatched(reference, dets);
+		}
+	}
+
+	if (!nimages)
+		return 1;
+
+	printf("%d images, %d objects\n", nimages, nreference);
+	printf("dense:         %8.2f ms per image\n", 1000*times[nschedules]/nimages);
+	for (int k = 0; k < nschedules; ++k)
+		printf("skips %d %d %d: %8.2f ms per image (%.2fx), recall %.3f\n",
+			schedules[k][0], schedules[k][1], schedules[k][2], 1000*times[k]/nimages, times[nschedules]/times[k],
+			nreference ? nmatched[k]/(float)nreference : 1.0f);
+
+	return 0;
+}
@@ -0,0 +1,168 @@
+/*
+	Compares the TiledImage layout with the row-major one on a 4K frame, for one window size at a time,
+	with the function generated by picogen and with find_objects on a scan plan.
+
+		$ ./tiled-benchmark CASCADE [IMAGE.pgm]
+
+	The generated functions are the face detector built into the runtime (cascades/face-cpu.h), so CASCADE
+	should be the facefinder it was generated from. Without an image, a 3840x2160 synthetic (smooth, noisy)
+	texture is scanned. Every time is the best of NRUNS runs.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "../picornt.h"
+
+// generated by picogen, compiled into the runtime library
+int facedet(float* o, int r, int c, int s, const uint8_t* pixels, int nrows, int ncols, int ldim);
+int facedet_tiled(float* o, int r, int c, int s, const uint8_t* pixels, int nrows, int ncols, int ntilecols);
+
+static double get_time()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+static bool load_pgm(const char *path, std::vector<uint8_t> &pixels, int *nrows, int *ncols)
+{
+	FILE *file = fopen(path, "rb");
+	if (!file)
+		return false;
+
+	int maxval;
+	if (fscanf(file, "P5 %d %d %d", ncols, nrows, &maxval) != 3 || maxval != 255)
+	{
+		fclose(file);
+		return false;
+	}
+	fgetc(file);
+
+	pixels.resize(*nrows * *ncols);
+	const bool ok = fread(&pixels[0], 1, pixels.size(), file) == pixels.size();
+	fclose(file);
+
+	return ok;
+}
+
+// blurred noise, so that the cascade does not reject every window at its first tree
+static void make_texture(std::vector<uint8_t> &pixels, int nrows, int ncols)
+{
+	std::vector<int> noise(nrows*ncols);
+	for (int i = 0; i < nrows*ncols; ++i)
+		noise[i] = rand()%256;
+
+	pixels.resize(nrows*ncols);
+	for (int r = 0; r < nrows; ++r)
+		for (int c = 0; c < ncols; ++c)
+		{
+			int sum = 0, n = 0;
+			for (int i = r-2; i <= r+2; ++i)
+				for (int j = c-2; j <= c+2; ++j)
+					if (i >= 0 && i < nrows && j >= 0 && j < ncols)
+					{
+						sum += noise[i*ncols + j];
+						++n;
+					}
+			pixels[r*ncols + c] = sum/n;
+		}
+}
+
+#define NRUNS 3
+#define MAXNDETECTIONS 1000000
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2)
+	{
+		printf("usage: %s CASCADE [IMAGE.pgm]\n", argv[0]);
+		return 1;
+	}
+
+	RuntimeCascade cascade;
+	if (!cascade.load(argv[1]))
+	{
+		printf("cannot load %s\n", argv[1]);
+		return 1;
+	}
+
+	const float scalefactor = 1.1f;
+	const float stridefactor = 0.1f;
+
+	int nrows = 2160, ncols = 3840;
+	std::vector<uint8_t> pixels;
+	if (argc > 2)
+	{
+		if (!load_pgm(argv[2], pixels, &nrows, &ncols))
+		{
+			printf("cannot load %s\n", argv[2]);
+			return 1;
+		}
+	}
+	else
+		make_texture(pixels, nrows, ncols);
+
+	TiledImage tiled;
+	double tcopy = 1e9;
+	for (int run = 0; run < NRUNS; ++run)
+	{
+		const double t = get_time();
+		tiled.copy(&pixels[0], nrows, ncols, ncols);
+		tcopy = std::min(tcopy, get_time() - t);
+	}
+
+	std::vector<float> rs(MAXNDETECTIONS), cs(MAXNDETECTIONS), ss(MAXNDETECTIONS), qs(MAXNDETECTIONS);
+
+	printf("%dx%d, stride %g, copy to tiles %.2f ms\n", ncols, nrows, stridefactor, 1000*tcopy);
+	printf("  size   generated (row-major, tiled, speedup)   plan (row-major, tiled, speedup)\n");
+
+	const int nsizes = 6;
+	const int sizes[nsizes] = {24, 48, 96, 192, 384, 768};
+	for (int i = 0; i < nsizes && sizes[i] < std::min(nrows, ncols); ++i)
+	{
+		const float s = sizes[i];
+
+		ScanPlan plan;
+		plan.prepare(cascade.tables(), nrows, ncols, ncols, scalefactor, stridefactor, s, s, true);
+
+		// 0 and 1 are the generated function, 2 and 3 the plan, each for the row-major and the tiled image
+		double times[4];
+		int n[4] = {0};
+		for (int k = 0; k < 4; ++k)
+		{
+			times[k] = 1e9;
+			for (int run = 0; run < NRUNS; ++run)
+			{
+				const double t = get_time();
+				if (k == 0)
+					n[k] = find_objects(&rs[0], &cs[0], &ss[0], &qs[0], MAXNDETECTIONS,
+						facedet, &pixels[0], nrows, ncols, ncols,
+						scalefactor, stridefactor, s, s);
+				else if (k == 1)
+					n[k] = find_objects(&rs[0], &cs[0], &ss[0], &qs[0], MAXNDETECTIONS,
+						facedet_tiled, tiled.pixels(), nrows, ncols, tiled.ntilecols(),
+						scalefactor, stridefactor, s, s);
+				else if (k == 2)
+					n[k] = find_objects(&rs[0], &cs[0], &ss[0], &qs[0], MAXNDETECTIONS,
+						plan, &pixels[0]);
+				else
+					n[k] = find_objects(&rs[0], &cs[0], &ss[0], &qs[0], MAXNDETECTIONS,
+						plan, tiled);
+				times[k] = std::min(times[k], get_time() - t);
+			}
+		}
+
+		printf("  %4d   %8.2f ms %8.2f ms   %.2fx        %8.2f ms %8.2f ms   %.2fx%s\n", sizes[i],
+			1000*times[0], 1000*times[1], times[0]/times[1],
+			1000*times[2], 1000*times[3], times[2]/times[3],
+			n[0] == n[1] && n[2] == n[3] ? "" : "   (detections differ)");
+	}
+
+	return 0;
+}
@@ -0,0 +1,144 @@
+#include "picornt.h"
+
+#include <algorithm>
+
+void ScalePrior::set(const float *minsizes, const float *maxsizes, int nrows)
+{
+	nrows = std::max(0, nrows);
+
+	this->minsizes.assign(minsizes, minsizes + nrows);
+	this->maxsizes.assign(maxsizes, maxsizes + nrows);
+}
+
+void ScalePrior::set_knots(const float *rows, const float *minsizes, const float *maxsizes, int n, int nrows)
+{
+	if (n <= 0 || nrows <= 0)
+	{
+		clear();
+		return;
+	}
+
+	this->minsizes.resize(nrows);
+	this->maxsizes.resize(nrows);
+
+	int k = 0;
+	for (int r = 0; r < nrows; ++r)
+	{
+		while (k < n && rows[k] <= r)
+			++k;
+
+		// between knots k-1 and k
+		if (k == 0)
+		{
+			this->minsizes[r] = minsizes[0];
+			this->maxsizes[r] = maxsizes[0];
+		}
+		else if (k == n)
+		{
+			this->minsizes[r] = minsizes[n-1];
+			this->maxsizes[r] = maxsizes[n-1];
+		}
+		else
+		{
+			const float t = (r - rows[k-1])/(rows[k] - rows[k-1]);
+			this->minsizes[r] = minsizes[k-1] + t*(minsizes[k] - minsizes[k-1]);
+			this->maxsizes[r] = maxsizes[k-1] + t*(maxsizes[k] - maxsizes[k-1]);
+		}
+	}
+}
+
+void ScalePrior::add_samples(const float *rs, const float *ss, int n)
+{
+	for (int i = 0; i < n; ++i)
+	{
+		samples.push_back(rs[i]);
+		samples.push_back(ss[i]);
+	}
+}
+
+bool ScalePrior::learn(int nrows, float margin)
+{
+	const int n = nsamples();
+	if (n < SCALE_PRIOR_MIN_SAMPLES || nrows <= 0)
+		return false;
+
+	margin = std::max(1.0f, margin);
+
+	// least squares fit of s = a + b*r
+	double mr = 0.0, ms = 0.0;
+	for (int i = 0; i < n; ++i)
+	{
+		mr += samples[2*i+0];
+		ms += samples[2*i+1];
+	}
+	mr /= n;
+	ms /= n;
+
+	double vr = 0.0, crs = 0.0;
+	for (int i = 0; i < n; ++i)
+	{
+		vr += (samples[2*i+0] - mr)*(samples[2*i+0] - mr);
+		crs += (samples[2*i+0] - mr)*(samples[2*i+1] - ms);
+	}
+
+	const double b = vr > 0.0 ? crs/vr : 0.0;
+	const double a = ms - b*mr;
+
+	// the sizes relative to the line, without the most extreme 1% on either side
+	std::vector<float> ratios(n);
+	for (int i = 0; i < n; ++i)
+		ratios[i] = samples[2*i+1]/std::max(a + b*samples[2*i+0], 1.0);
+	std::sort(ratios.begin(), ratios.end());
+
+	const float lo = ratios[n/100]/margin;
+	const float hi = ratios[n-1 - n/100]*margin;
+
+	minsizes.resize(nrows);
+	maxsizes.resize(nrows);
+	for (int r = 0; r < nrows; ++r)
+	{
+		const float s = std::max(a + b*r, 1.0);
+		minsizes[r] = lo*s;
+		maxsizes[r] = hi*s;
+	}
+
+	return true;
+}
+
+int find_objects(float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	int (*detection_func)(float*, int, int, int, const uint8_t*, int, int, int),
+	const ScalePrior &prior,
+	const uint8_t *pixels, int nrows, int ncols, int ldim,
+	float scalefactor, float stridefactor, float minsize, float maxsize)
+{
+	int ndetections = 0;
+	for (float s = minsize; s <= maxsize; s *= scalefactor)
+	{
+		float dr = std::max(stridefactor * s, 1.0f);
+		float dc = dr;
+
+		for (float r = s/2+1; r <= nrows-s/2-1; r += dr)
+		{
+			if (!prior.allows(r, s))
+				continue;
+
+			for (float c = s/2+1; c <= ncols-s/2-1; c += dc)
+			{
+				if (ndetections >= maxndetections)
+					return ndetections;
+
+				float q;
+				if (detection_func(&q, r, c, s, pixels, nrows, ncols, ldim) != 1)
+					continue;
+
+				qs[ndetections] = q;
+				rs[ndetections] = r;
+				cs[ndetections] = c;
+				ss[ndetections] = s;
+				++ndetections;
+			}
+		}
+	}
+
+	return ndetections;
+}
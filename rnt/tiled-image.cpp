@@ -0,0 +1,44 @@
+#include "picornt.h"
+
+#include <cstring>
+
+TiledImage::TiledImage() :
+	data(0),
+	rows(0), cols(0), tilecols(0)
+{}
+
+void TiledImage::copy(const uint8_t *pixels, int nrows, int ncols, int ldim)
+{
+	const int tilerows = (nrows + TILED_IMAGE_TILE-1)/TILED_IMAGE_TILE;
+	tilecols = (ncols + TILED_IMAGE_TILE-1)/TILED_IMAGE_TILE;
+	rows = nrows;
+	cols = ncols;
+
+	// resize() keeps the capacity, so the buffer is only reallocated when a frame needs more
+	const size_t tilesize = TILED_IMAGE_TILE*TILED_IMAGE_TILE;
+	buffer.resize((size_t)tilerows*tilecols*tilesize + 63);
+	data = &buffer[0] + (64 - (uintptr_t)&buffer[0]%64)%64;
+
+	rowtable.resize(nrows);
+	for (int r = 0; r < nrows; ++r)
+		rowtable[r] = get_tiled_index(r, 0, tilecols);
+	coltable.resize(ncols);
+	for (int c = 0; c < ncols; ++c)
+		coltable[c] = get_tiled_index(0, c, tilecols);
+
+	// the tiles on the right and bottom edges are padded with zeros
+	for (int tr = 0; tr < tilerows; ++tr)
+		for (int tc = 0; tc < tilecols; ++tc)
+		{
+			uint8_t *tile = &data[((size_t)tr*tilecols + tc)*tilesize];
+
+			const int r0 = tr*TILED_IMAGE_TILE;
+			const int c0 = tc*TILED_IMAGE_TILE;
+			const int n = ncols - c0 < TILED_IMAGE_TILE ? ncols - c0 : TILED_IMAGE_TILE;
+			if (n < TILED_IMAGE_TILE || r0 + TILED_IMAGE_TILE > nrows)
+				memset(tile, 0, tilesize);
+
+			for (int r = r0; r < r0 + TILED_IMAGE_TILE && r < nrows; ++r)
+				memcpy(&tile[(r - r0)*TILED_IMAGE_TILE], &pixels[(size_t)r*ldim + c0], n);
+		}
+}
@@ -0,0 +1,166 @@
+#include "picornt.h"
+
+#include <algorithm>
+
+// window centres along one image axis, accumulated exactly as in find_objects
+static void get_scan_positions(std::vector<float> &ps, float s, float step, int n)
+{
+	ps.clear();
+	for (float p = s/2+1; p <= n-s/2-1; p += step)
+		ps.push_back(p);
+}
+
+// positions [first, last) of the window centres in [lo, hi]
+static inline void get_position_range(const std::vector<float> &ps, float lo, float hi, int *first, int *last)
+{
+	*first = std::lower_bound(ps.begin(), ps.end(), lo) - ps.begin();
+	*last = std::upper_bound(ps.begin(), ps.end(), hi) - ps.begin();
+}
+
+VideoDetector::VideoDetector() :
+	nframes(10),
+	margin(0.5f),
+	sizemargin(1.3f),
+	minquality(0.0f),
+	nrows(0), ncols(0),
+	scalefactor(0.0f), stridefactor(0.0f), minsize(0.0f), maxsize(0.0f),
+	frame(0),
+	nclassified(0)
+{}
+
+void VideoDetector::configure(int nframes, float margin, float sizemargin, float minquality)
+{
+	this->nframes = std::max(1, nframes);
+	this->margin = std::max(0.0f, margin);
+	this->sizemargin = std::max(1.0f, sizemargin);
+	this->minquality = minquality;
+}
+
+void VideoDetector::reset()
+{
+	frame = 0;
+	objects.clear();
+}
+
+int VideoDetector::detect(float *rs, float *cs, float *ss, float *qs, int maxndetections,
+	int (*detection_func)(float*, int, int, int, const uint8_t*, int, int, int),
+	const uint8_t *pixels, int nrows, int ncols, int ldim,
+	float scalefactor, float stridefactor, float minsize, float maxsize)
+{
+	if (nrows != this->nrows || ncols != this->ncols || scalefactor != this->scalefactor ||
+		stridefactor != this->stridefactor || minsize != this->minsize || maxsize != this->maxsize)
+	{
+		this->nrows = nrows;
+		this->ncols = ncols;
+		this->scalefactor = scalefactor;
+		this->stridefactor = stridefactor;
+		this->minsize = minsize;
+		this->maxsize = maxsize;
+
+		scales.clear();
+		for (float s = minsize; s <= maxsize; s *= scalefactor)
+		{
+			float dr = std::max(stridefactor * s, 1.0f);
+			float dc = dr;
+
+			scales.push_back(Scale());
+			scales.back().s = s;
+			get_scan_positions(scales.back().rows, s, dr, nrows);
+			get_scan_positions(scales.back().cols, s, dc, ncols);
+		}
+
+		reset();
+	}
+
+	for (int k = 0; k < 4; ++k)
+		dets[k].clear();
+	nclassified = 0;
+
+	// windows [i0, i1) x [j0, j1) to classify at the current scale: the band of the full scan, then
+	// the neighbourhood of every object; the windows of earlier rectangles are not classified again
+	std::vector<int> rects;
+
+	for (int k = 0; k < (int)scales.size(); ++k)
+	{
+		const Scale &scale = scales[k];
+		const int nr = scale.rows.size();
+
+		// the share of the full scan: one band of rows out of nframes
+		int band0 = 0, band1 = nr;
+		if (frame > 0)
+		{
+			band0 = (int)((long long)nr*(frame%nframes)/nframes);
+			band1 = (int)((long long)nr*(frame%nframes + 1)/nframes);
+		}
+
+		rects.clear();
+		rects.push_back(band0);
+		rects.push_back(band1);
+		rects.push_back(0);
+		rects.push_back(scale.cols.size());
+
+		if (band0 > 0 || band1 < nr)
+			for (size_t o = 0; o < objects.size(); o += 3)
+			{
+				const float r = objects[o+0];
+				const float c = objects[o+1];
+				const float s = objects[o+2];
+				if (scale.s < s/sizemargin || scale.s > s*sizemargin)
+					continue;
+
+				int i0, i1, j0, j1;
+				get_position_range(scale.rows, r - margin*s, r + margin*s, &i0, &i1);
+				get_position_range(scale.cols, c - margin*s, c + margin*s, &j0, &j1);
+
+				rects.push_back(i0);
+				rects.push_back(i1);
+				rects.push_back(j0);
+				rects.push_back(j1);
+			}
+
+		for (size_t q = 0; q < rects.size(); q += 4)
+			for (int i = rects[q+0]; i < rects[q+1]; ++i)
+				for (int j = rects[q+2]; j < rects[q+3]; ++j)
+				{
+					bool seen = false;
+					for (size_t p = 0; p < q && !seen; p += 4)
+						seen = i >= rects[p+0] && i < rects[p+1] && j >= rects[p+2] && j < rects[p+3];
+					if (seen)
+						continue;
+
+					float o;
+					++nclassified;
+					if (detection_func(&o, scale.rows[i], scale.cols[j], scale.s, pixels, nrows, ncols, ldim) != 1)
+						continue;
+
+					dets[0].push_back(scale.rows[i]);
+					dets[1].push_back(scale.cols[j]);
+					dets[2].push_back(scale.s);
+					dets[3].push_back(o);
+				}
+	}
+
+	int n = dets[0].size();
+	if (n)
+		n = cluster_detections(&dets[0][0], &dets[1][0], &dets[2][0], &dets[3][0], n);
+
+	// the objects to look for in the next frame
+	objects.clear();
+	for (int i = 0; i < n; ++i)
+		if (dets[3][i] >= minquality)
+		{
+			objects.push_back(dets[0][i]);
+			objects.push_back(dets[1][i]);
+			objects.push_back(dets[2][i]);
+		}
+
+	n = std::min(n, std::max(0, maxndetections));
+	std::copy(dets[0].begin(), dets[0].begin() + n, rs);
+	std::copy(dets[1].begin(), dets[1].begin() + n, cs);
+	std::copy(dets[2].begin(), dets[2].begin() + n, ss);
+	std::copy(dets[3].begin(), dets[3].begin() + n, qs);
+
+	++frame;
+
+	return n;
+}
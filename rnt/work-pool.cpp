@@ -0,0 +1,165 @@
+#include "work-pool.h"
+
+#include <algorithm>
+
+WorkStealingPool::WorkStealingPool(int nthreads) :
+	nworkers(nthreads > 0 ? nthreads : std::max(1, int(std::thread::hardware_concurrency()))),
+	nactive(nworkers),
+	queues(nworkers),
+	cur_task(0),
+	generation(0),
+	nbusy(0),
+	stop(false)
+{
+	for (int i = 1; i < nworkers; ++i)
+		threads.push_back(std::thread(&WorkStealingPool::worker_loop, this, i));
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+	{
+		std::lock_guard<std::mutex> lk(lock);
+		stop = true;
+	}
+	wake.notify_all();
+
+	for (size_t i = 0; i < threads.size(); ++i)
+		threads[i].join();
+}
+
+void WorkStealingPool::run(int ntasks, const std::function<void(int)> &task, int nthreads)
+{
+	if (ntasks <= 0)
+		return;
+
+	if (nthreads <= 0 || nthreads > nworkers)
+		nthreads = nworkers;
+
+	if (nthreads == 1)
+	{
+		for (int i = 0; i < ntasks; ++i)
+			task(i);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lk(lock);
+
+		// deal the tasks round-robin, stealing evens out the rest
+		for (int i = 0; i < ntasks; ++i)
+		{
+			Queue &q = queues[i % nthreads];
+			std::lock_guard<std::mutex> qlk(q.lock);
+			q.tasks.push_back(i);
+		}
+
+		cur_task = &task;
+		nactive = nthreads;
+		nbusy = nworkers - 1;
+		++generation;
+	}
+	wake.notify_all();
+
+	work(0);
+
+	std::unique_lock<std::mutex> lk(lock);
+	while (nbusy > 0)
+		done.wait(lk);
+	cur_task = 0;
+}
+
+void WorkStealingPool::run_in_order(int ntasks, const std::function<void(int)> &task, int nthreads)
+{
+	if (nthreads <= 0 || nthreads > nworkers)
+		nthreads = nworkers;
+
+	// a single thread runs the tasks in order, with several every worker takes its own tasks
+	// from the back of its queue, so numbering them backwards lets them go roughly in order
+	if (nthreads == 1)
+		run(ntasks, task, nthreads);
+	else
+		run(ntasks, [&](int i) { task(ntasks-1 - i); }, nthreads);
+}
+
+bool WorkStealingPool::pop_task(int worker, int *task)
+{
+	{
+		Queue &q = queues[worker];
+		std::lock_guard<std::mutex> qlk(q.lock);
+		if (!q.tasks.empty())
+		{
+			*task = q.tasks.back();
+			q.tasks.pop_back();
+			return true;
+		}
+	}
+
+	for (int i = 1; i < nactive; ++i)
+	{
+		Queue &q = queues[(worker + i) % nactive];
+		std::lock_guard<std::mutex> qlk(q.lock);
+		if (!q.tasks.empty())
+		{
+			*task = q.tasks.front();
+			q.tasks.pop_front();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void WorkStealingPool::work(int worker)
+{
+	// no new tasks are queued while a run is in progress,
+	// so empty queues mean that this worker is done
+	int task;
+	while (pop_task(worker, &task))
+		(*cur_task)(task);
+}
+
+void WorkStealingPool::worker_loop(int worker)
+{
+	int seen = 0;
+	std::unique_lock<std::mutex> lk(lock);
+	for (;;)
+	{
+		while (!stop && generation == seen)
+			wake.wait(lk);
+		if (stop)
+			return;
+		seen = generation;
+
+		// workers left out of this run only report back
+		if (worker < nactive)
+		{
+			lk.unlock();
+			work(worker);
+			lk.lock();
+		}
+
+		if (--nbusy == 0)
+			done.notify_one();
+	}
+}
+
+OrderedCounts::OrderedCounts(int ntasks) :
+	counts(ntasks)
+{
+	for (int i = 0; i < ntasks; ++i)
+		counts[i].store(-1);
+}
+
+int OrderedCounts::get_before(int first, int task, int limit) const
+{
+	int before = 0;
+	for (int i = task-1; i >= first && before < limit; --i)
+	{
+		const int n = counts[i].load();
+		if (n < 0)
+			return 0;
+		before += n;
+	}
+
+	return before;
+}
@@ -0,0 +1,79 @@
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// persistent thread pool with per-worker task queues
+// each worker takes tasks from the back of its own queue
+// and steals from the front of the others when it runs dry
+class WorkStealingPool
+{
+public:
+	// nthreads <= 0 means "use all hardware threads"
+	explicit WorkStealingPool(int nthreads);
+	~WorkStealingPool();
+
+	// calls task(i) for every i in [0, ntasks) and waits for all of them
+	// the calling thread works as worker 0
+	// only the first nthreads workers take part (nthreads <= 0 or > size() means all of them)
+	void run(int ntasks, const std::function<void(int)> &task, int nthreads = 0);
+
+	// same as run, but the tasks are started roughly in increasing order of i
+	// (for tasks listed in output order which stop early, see OrderedCounts)
+	void run_in_order(int ntasks, const std::function<void(int)> &task, int nthreads = 0);
+
+	int size() const { return nworkers; }
+
+private:
+	WorkStealingPool(const WorkStealingPool&);
+	WorkStealingPool& operator=(const WorkStealingPool&);
+
+	struct Queue
+	{
+		std::mutex lock;
+		std::deque<int> tasks;
+	};
+
+	bool pop_task(int worker, int *task);
+	void work(int worker);
+	void worker_loop(int worker);
+
+	int nworkers;
+	int nactive;
+	std::vector<Queue> queues;
+	std::vector<std::thread> threads;
+
+	std::mutex lock;
+	std::condition_variable wake;
+	std::condition_variable done;
+	const std::function<void(int)> *cur_task;
+	int generation;
+	int nbusy;
+	bool stop;
+};
+
+// result counts of tasks listed in output order, for tasks that produce results until the output is full:
+// once the tasks before a task are done, it knows how many of the results it can still add
+class OrderedCounts
+{
+public:
+	explicit OrderedCounts(int ntasks);
+
+	// the task is done and has count results
+	void set(int task, int count) { counts[task].store(count); }
+
+	// sum of the counts of the tasks [first, task) if they are all done (summed up to limit at most),
+	// 0 if some of them are not
+	int get_before(int first, int task, int limit) const;
+
+private:
+	std::vector<std::atomic<int> > counts;  // -1 until the task is done
+};
+
+#endif // WORKPOOL_H